@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "redblack.h"
+#include "probe.h"
+
+/* ================== Compressed grid store ================== *
+ * Interior rows are kept in bands of tileRows rows. Each value is
+ * quantised to q = round(v / (2 * errorBound)), so it comes back within
+ * errorBound, and every row is stored as its first q followed by the
+ * differences between neighbours. A smooth field has small differences,
+ * so a band picks the narrowest of 1, 2 or 4 byte deltas that holds them
+ * all, or plain doubles when none does. Values too fine for their
+ * quantised form to fit in a long are kept as plain doubles. A half
+ * sweep decompresses one band and its two ghost rows into a cache-sized
+ * strip, sweeps it and recompresses it. */
+
+typedef struct band
+{
+    int width;          // bytes per delta, sizeof(double) for raw values
+    long *first;        // quantised column 1 of each row
+    void *data;         // deltas of columns 2..N, or raw columns 1..N
+    size_t bytes;
+} band;
+
+static rbOptions *opt;
+static band      *bands;
+static rbGrid    *strip;
+static double    *top, *bottom;     // the fixed boundary rows
+static long      *quant;            // scratch for one band
+static int       numBands, tileRows;
+static int       raw;               // every band stored as plain doubles
+static double    step, invStep;
+
+static double storeBytes()
+{
+    int b;
+    double total = 2.0 * (opt->N + 2) * sizeof(double);
+
+    for (b = 0; b < numBands; b++)
+        total += bands[b].bytes;
+    return total;
+}
+
+static int bandRows(int b)
+{
+    return MIN(tileRows, opt->N - b * tileRows);
+}
+
+/* Round to nearest without lround(), which does not vectorise */
+static inline long quantise(double v)
+{
+    v *= invStep;
+    return (long) (v + (v >= 0 ? 0.5 : -0.5));
+}
+
+static void compressBand(band *bd, int rows, double **src)
+{
+    int r, j, N = opt->N, width;
+    long maxDelta = 0, *q;
+    size_t count = (size_t) rows * (N - 1);
+
+    if (raw)
+        maxDelta = -1;
+    for (r = 0; r < rows && maxDelta >= 0; r++)
+    {
+        q = &quant[(size_t) r * N];
+        for (j = 0; j < N; j++)
+            q[j] = quantise(src[r][j+1]);
+        for (j = 1; j < N; j++)
+            maxDelta = MAX(maxDelta, labs(q[j] - q[j-1]));
+    }
+
+    if (maxDelta < 0)
+        width = sizeof(double);
+    else if (maxDelta <= 127)
+        width = 1;
+    else if (maxDelta <= 32767)
+        width = 2;
+    else if (maxDelta <= 2147483647l)
+        width = 4;
+    else width = sizeof(double);
+
+    if (width != bd->width)
+    {
+        free(bd->data);
+        bd->width = width;
+        bd->bytes = (width == sizeof(double)) ? (size_t) rows * N * sizeof(double)
+                                              : count * width;
+        bd->data = malloc(bd->bytes);
+        bd->bytes += rows * sizeof(long);
+    }
+
+    for (r = 0; r < rows; r++)
+    {
+        signed char *d1 = (signed char *) bd->data + (size_t) r * (N - 1);
+        short *d2 = (short *) bd->data + (size_t) r * (N - 1);
+        int *d4 = (int *) bd->data + (size_t) r * (N - 1);
+
+        q = &quant[(size_t) r * N];
+        bd->first[r] = q[0];
+        switch (width)
+        {
+            case 1  : for (j = 1; j < N; j++)
+                          d1[j-1] = q[j] - q[j-1];
+                      break;
+            case 2  : for (j = 1; j < N; j++)
+                          d2[j-1] = q[j] - q[j-1];
+                      break;
+            case 4  : for (j = 1; j < N; j++)
+                          d4[j-1] = q[j] - q[j-1];
+                      break;
+            default : memcpy((double *) bd->data + (size_t) r * N, &src[r][1], N * sizeof(double));
+        }
+    }
+}
+
+/* Rows r0..r1 of a band into dst[0..], boundary columns included */
+static void decompressRows(band *bd, int r0, int r1, double **dst)
+{
+    int r, j, N = opt->N;
+    long q;
+
+    for (r = r0; r <= r1; r++)
+    {
+        double *row = dst[r - r0];
+        signed char *d1 = (signed char *) bd->data + (size_t) r * (N - 1);
+        short *d2 = (short *) bd->data + (size_t) r * (N - 1);
+        int *d4 = (int *) bd->data + (size_t) r * (N - 1);
+
+        row[0] = row[N+1] = 1;
+        q = bd->first[r];
+        row[1] = q * step;
+        switch (bd->width)
+        {
+            case 1  : for (j = 1; j < N; j++)
+                      {
+                          q += d1[j-1];
+                          row[j+1] = q * step;
+                      }
+                      break;
+            case 2  : for (j = 1; j < N; j++)
+                      {
+                          q += d2[j-1];
+                          row[j+1] = q * step;
+                      }
+                      break;
+            case 4  : for (j = 1; j < N; j++)
+                      {
+                          q += d4[j-1];
+                          row[j+1] = q * step;
+                      }
+                      break;
+            default : memcpy(&row[1], (double *) bd->data + (size_t) r * N, N * sizeof(double));
+        }
+    }
+}
+
+/* Bring band b and its ghost rows into the strip */
+static void loadBand(int b)
+{
+    int rows = bandRows(b);
+
+    strip->firstRow = b * tileRows + 1;
+    strip->height = rows;
+    if (b == 0)
+        memcpy(strip->rows[0], top, (opt->N + 2) * sizeof(double));
+    else decompressRows(&bands[b-1], bandRows(b-1) - 1, bandRows(b-1) - 1, &strip->rows[0]);
+    decompressRows(&bands[b], 0, rows - 1, &strip->rows[1]);
+    if (b == numBands - 1)
+        memcpy(strip->rows[rows+1], bottom, (opt->N + 2) * sizeof(double));
+    else decompressRows(&bands[b+1], 0, 0, &strip->rows[rows+1]);
+}
+
+static int runCompressed(rbOptions *options, rbResult *res)
+{
+    int b, i, j, iters, check, kernel, N;
+    double startTime, rawBytes, peakBytes, maxdiff = 0.0, halfdiff, maxAbs;
+    rbGrid *full;
+
+    opt = options;
+    N = opt->N;
+    if (N < 2)
+    {
+        fprintf(stderr, "The compressed store needs at least 2 columns\n");
+        return 1;
+    }
+    step = 2.0 * opt->errorBound;
+    invStep = (step > 0.0) ? 1.0 / step : 0.0;
+    kernel = (opt->kernel == KERNEL_FUSED) ? KERNEL_PLAIN : opt->kernel;
+    tileRows = (opt->tileRows > 0) ? MIN(opt->tileRows, N) : MIN(16, N);
+    numBands = (N + tileRows - 1) / tileRows;
+
+    strip = allocateGrid(N, tileRows, 1, opt->layout);
+    top = (double *) malloc((N + 2) * sizeof(double));
+    bottom = (double *) malloc((N + 2) * sizeof(double));
+    quant = (long *) malloc((size_t) tileRows * N * sizeof(long));
+    bands = (band *) calloc(numBands, sizeof(band));
+
+    /* Compress the initial grid one band at a time. The sweeps only
+     * average, so no value ever leaves the initial grid's range; a zero
+     * error bound, or one so small that a quantised value or the
+     * difference of two could overflow a long, keeps the values exactly. */
+    strip->firstRow = 0;
+    initRows(strip, 1, 1);
+    memcpy(top, strip->rows[1], (N + 2) * sizeof(double));
+    memcpy(bottom, top, (N + 2) * sizeof(double));
+    maxAbs = 0.0;
+    for (j = 0; j < N + 2; j++)
+        maxAbs = MAX(maxAbs, MAX(fabs(top[j]), fabs(bottom[j])));
+    for (b = 0; b < numBands; b++)
+    {
+        strip->firstRow = b * tileRows + 1;
+        initRows(strip, 1, bandRows(b));
+        for (i = 1; i <= bandRows(b); i++)
+            for (j = 0; j < N + 2; j++)
+                maxAbs = MAX(maxAbs, fabs(strip->rows[i][j]));
+    }
+    raw = (step <= 0.0 || 2.0 * maxAbs * invStep + 1.0 >= (double) LONG_MAX / 2);
+
+    for (b = 0; b < numBands; b++)
+    {
+        bands[b].first = (long *) malloc(bandRows(b) * sizeof(long));
+        strip->firstRow = b * tileRows + 1;
+        initRows(strip, 1, bandRows(b));
+        compressBand(&bands[b], bandRows(b), &strip->rows[1]);
+    }
+
+    PROBE_INIT(1, opt->maxIters + 1);
+    PROBE_THREAD_INIT(0);
+
+    peakBytes = storeBytes();
+    startTime = wallTime();
+    for (iters = 1; iters <= opt->maxIters + 1; iters++)
+    {
+        check = wantDiff(opt, iters);
+        maxdiff = 0.0;
+        PROBE_BEGIN(0);
+        for (b = 0; b < numBands; b++)
+        {
+            loadBand(b);
+            halfdiff = halfSweep(strip, kernel, RED, 1, strip->height, check);
+            maxdiff = MAX(maxdiff, halfdiff);
+            compressBand(&bands[b], strip->height, &strip->rows[1]);
+        }
+        for (b = 0; b < numBands; b++)
+        {
+            loadBand(b);
+            halfdiff = halfSweep(strip, kernel, BLACK, 1, strip->height, check);
+            maxdiff = MAX(maxdiff, halfdiff);
+            compressBand(&bands[b], strip->height, &strip->rows[1]);
+        }
+        peakBytes = MAX(peakBytes, storeBytes());
+        PROBE_END(0, PHASE_COMPUTE);
+        PROBE_ITER(0);
+        if (check && converged(opt, maxdiff))
+            break;
+    }
+    res->time = wallTime() - startTime;
+    PROBE_REPORT(0, 1);
+    PROBE_FREE();
+
+    res->iters = MIN(iters, opt->maxIters + 1);
+    res->maxdiff = maxdiff;
+    res->threads = 1;
+    res->isRoot = 1;
+
+    rawBytes = (double) (N + 2) * (N + 2) * sizeof(double);
+    printf("#Store : %.3lf MB of %.3lf MB raw (%.1lf%% saved, peak %.3lf MB)\t"
+           "Error bound : %g\tGLUP/s : %.4lf\n", storeBytes() / 1e6, rawBytes / 1e6,
+           100.0 * (1.0 - storeBytes() / rawBytes), peakBytes / 1e6, opt->errorBound,
+           (double) N * N * res->iters / res->time / 1e9);
+
+    if (N <= opt->printLimit)
+    {
+        full = allocateGrid(N, N, 1, LAYOUT_NATURAL);
+        memcpy(full->rows[0], top, (N + 2) * sizeof(double));
+        for (b = 0; b < numBands; b++)
+            decompressRows(&bands[b], 0, bandRows(b) - 1, &full->rows[b * tileRows + 1]);
+        memcpy(full->rows[N+1], bottom, (N + 2) * sizeof(double));
+        res->grid = full;
+    }
+
+    for (b = 0; b < numBands; b++)
+    {
+        free(bands[b].first);
+        free(bands[b].data);
+    }
+    free(bands);
+    free(quant);
+    free(top);
+    free(bottom);
+    freeGrid(strip);
+    return 0;
+}
+
+rbBackend compressedBackend = {"compressed", "bands stored as quantised deltas within -q <bound>",
+                               runCompressed, 0};
@@ -0,0 +1,283 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "redblack.h"
+#include "probe.h"
+
+#define TAG 13
+
+static MPI_Comm comm;   // the ranks in strip order
+
+/* A 1-D Cartesian communicator over the strips. With place set, ranks are
+ * first sorted by (node, socket, world rank), as far as the MPI library
+ * can tell, so neighbouring strips share a node and halo traffic stays
+ * in memory; reorder then lets the library improve on that. */
+static MPI_Comm placeRanks(int place)
+{
+    int i, rank, size, before = 0, mine[2], *all, dims[1], periods[1] = {0};
+    MPI_Comm node, ordered, cart;
+#ifdef OPEN_MPI
+    MPI_Comm socket;
+#endif
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    mine[0] = mine[1] = rank;
+    if (place)
+    {
+        // the lowest world rank on my node, then on my socket, names them
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+        MPI_Allreduce(&rank, &mine[0], 1, MPI_INT, MPI_MIN, node);
+#ifdef OPEN_MPI
+        // unbound processes get no socket communicator
+        MPI_Comm_split_type(node, OMPI_COMM_TYPE_SOCKET, 0, MPI_INFO_NULL, &socket);
+        if (socket != MPI_COMM_NULL)
+        {
+            MPI_Allreduce(&rank, &mine[1], 1, MPI_INT, MPI_MIN, socket);
+            MPI_Comm_free(&socket);
+        }
+#endif
+        MPI_Comm_free(&node);
+    }
+
+    all = (int *) malloc(2 * size * sizeof(int));
+    MPI_Allgather(mine, 2, MPI_INT, all, 2, MPI_INT, MPI_COMM_WORLD);
+    for (i = 0; i < size; i++)
+        if (all[2*i] < mine[0] || (all[2*i] == mine[0] &&
+            (all[2*i+1] < mine[1] || (all[2*i+1] == mine[1] && i < rank))))
+            before++;
+    free(all);
+
+    MPI_Comm_split(MPI_COMM_WORLD, 0, before, &ordered);
+    dims[0] = size;
+    MPI_Cart_create(ordered, 1, dims, periods, 1, &cart);
+    MPI_Comm_free(&ordered);
+    return cart;
+}
+
+/* Trade boundary rows with the strips above (up) and below (down). Ranks
+ * at the edge of the grid talk to MPI_PROC_NULL. */
+static void exchangeHalos(rbGrid *grid, int up, int down)
+{
+    int count = grid->N + 2;
+
+    MPI_Sendrecv(grid->rows[1], count, MPI_DOUBLE, up, TAG,
+                 grid->rows[grid->height+1], count, MPI_DOUBLE, down, TAG,
+                 comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(grid->rows[grid->height], count, MPI_DOUBLE, down, TAG,
+                 grid->rows[0], count, MPI_DOUBLE, up, TAG,
+                 comm, MPI_STATUS_IGNORE);
+}
+
+/* Collect every strip into a full grid on rank 0 for printing */
+static rbGrid *gatherGrid(rbGrid *grid, int myrank, int numnodes)
+{
+    int i, firstRow, height, lo, hi, *counts = NULL, *displs = NULL;
+    rbGrid *full = NULL;
+
+    if (myrank == 0)
+    {
+        full = allocateGrid(grid->N, grid->N, 1, grid->layout);
+        initGrid(full);
+        counts = (int *) malloc(numnodes * sizeof(int));
+        displs = (int *) malloc(numnodes * sizeof(int));
+        for (i = 0; i < numnodes; i++)
+        {
+            // the outermost strips bring the boundary rows, which may have been loaded
+            stripBounds(grid->N, numnodes, i, &firstRow, &height);
+            lo = (firstRow == 1) ? 0 : firstRow;
+            hi = (firstRow + height - 1 == grid->N) ? grid->N + 1 : firstRow + height - 1;
+            counts[i] = (hi - lo + 1) * grid->stride;
+            displs[i] = lo * grid->stride;
+        }
+    }
+
+    lo = (grid->firstRow == 1) ? 0 : 1;
+    hi = (grid->firstRow + grid->height - 1 == grid->N) ? grid->height + 1 : grid->height;
+    MPI_Gatherv(grid->rows[lo], (hi - lo + 1) * grid->stride, MPI_DOUBLE,
+                full ? full->vals : NULL, counts, displs, MPI_DOUBLE,
+                0, comm);
+
+    free(counts);
+    free(displs);
+    return full;
+}
+
+/* Print the phase tables in rank order */
+static void reportProbes(int myrank, int numnodes)
+{
+#ifdef RB_PROBE
+    int r;
+    for (r = 0; r < numnodes; r++)
+    {
+        if (r == myrank)
+            PROBE_REPORT(myrank, myrank == 0);
+        MPI_Barrier(comm);
+    }
+    PROBE_FREE();
+#endif
+}
+
+static int runDistributed(rbOptions *opt, rbResult *res, int hybrid)
+{
+    int myrank, numnodes, firstRow, height, up, down, iters, check, initialized;
+    int pendingIter = 0, doneIter = 0;
+    double startTime, mydiff = 0.0, blackdiff, MAXDIFF = 0.0, sendDiff, recvDiff;
+    MPI_Request reduction = MPI_REQUEST_NULL;
+    rbIo *io;
+    rbTelemetry *tel;
+    rbGrid *grid;
+
+    MPI_Initialized(&initialized);
+    if (!initialized)
+        MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numnodes);
+
+    if (numnodes > opt->N)
+    {
+        if (myrank == 0)
+            fprintf(stderr, "More ranks (%d) than grid rows (%d)\n", numnodes, opt->N);
+        if (!initialized)
+            MPI_Finalize();
+        return 1;
+    }
+
+    comm = placeRanks(opt->placeRanks);
+    MPI_Comm_rank(comm, &myrank);
+
+#ifdef _OPENMP
+    if (hybrid)
+    {
+        omp_set_dynamic(0);
+        omp_set_num_threads(opt->numThreads);
+    }
+#endif
+
+    stripBounds(opt->N, numnodes, myrank, &firstRow, &height);
+    MPI_Cart_shift(comm, 0, 1, &up, &down);
+
+    /* Initialise my strip including the boundaries and ghost rows */
+    grid = allocateGrid(opt->N, height, firstRow, opt->layout);
+    io = startIo(opt, grid, myrank, 1);
+    tel = startTelemetry(opt, 1, myrank, numnodes);
+    initGrid(grid);
+    applyBoundary(io, 0, height + 1);
+    exchangeHalos(grid, up, down);
+    PROBE_INIT(1, opt->maxIters + 1);
+    PROBE_THREAD_INIT(0);
+
+    /* Ensure that no node moves ahead until the entire grid is initialised */
+    MPI_Barrier(comm);
+    startTime = wallTime();
+
+    for (iters = 1; iters <= opt->maxIters + 1; iters++)
+    {
+        check = wantDiff(opt, iters);
+        PROBE_BEGIN(0);
+        if (opt->kernel == KERNEL_FUSED)
+            mydiff = hybrid ? sweepFusedParallel(grid, 1, height, check)
+                            : sweepFused(grid, 1, height, check);
+        else if (hybrid)
+            mydiff = sweepRowsParallel(grid, opt->kernel, RED, 1, height, check, opt->chunkSize);
+        else mydiff = halfSweep(grid, opt->kernel, RED, 1, height, check);
+        PROBE_END(0, PHASE_COMPUTE);
+
+        /* The black points only need the neighbours' fresh red rows; with
+         * the fused kernel only the black halves of rows 1 and height remain */
+        PROBE_BEGIN(0);
+        exchangeHalos(grid, up, down);
+        PROBE_END(0, PHASE_HALO);
+
+        PROBE_BEGIN(0);
+        if (opt->kernel == KERNEL_FUSED)
+            blackdiff = sweepEdges(grid, 1, height, check);
+        else if (hybrid)
+            blackdiff = sweepRowsParallel(grid, opt->kernel, BLACK, 1, height, check, opt->chunkSize);
+        else blackdiff = halfSweep(grid, opt->kernel, BLACK, 1, height, check);
+        mydiff = MAX(mydiff, blackdiff);
+        PROBE_END(0, PHASE_COMPUTE);
+
+        PROBE_BEGIN(0);
+        exchangeHalos(grid, up, down);
+        PROBE_END(0, PHASE_HALO);
+
+        publishProgress(tel, 0, iters, mydiff, check);
+        if (snapshotDue(io, iters))
+            snapshotRows(io, iters, 0, height + 1);
+
+        /* The previous iteration's reduction has had a whole sweep to
+         * complete, so termination is decided one iteration late */
+        if (pendingIter)
+        {
+            PROBE_BEGIN(0);
+            MPI_Wait(&reduction, MPI_STATUS_IGNORE);
+            PROBE_END(0, PHASE_REDUCE);
+            MAXDIFF = recvDiff;
+            doneIter = pendingIter;
+            pendingIter = 0;
+            if (converged(opt, MAXDIFF))
+            {
+                PROBE_ITER(0);
+                break;
+            }
+        }
+        if (check)
+        {
+            sendDiff = mydiff;
+            MPI_Iallreduce(&sendDiff, &recvDiff, 1, MPI_DOUBLE, MPI_MAX, comm,
+                           &reduction);
+            pendingIter = iters;
+        }
+        PROBE_ITER(0);
+    }
+
+    if (pendingIter)
+    {
+        PROBE_BEGIN(0);
+        MPI_Wait(&reduction, MPI_STATUS_IGNORE);
+        PROBE_END(0, PHASE_REDUCE);
+        MAXDIFF = recvDiff;
+        doneIter = pendingIter;
+    }
+
+    PROBE_BEGIN(0);
+    MPI_Barrier(comm);
+    PROBE_END(0, PHASE_BARRIER);
+    res->time = wallTime() - startTime;
+    stopIo(io);
+    stopTelemetry(tel);
+    reportProbes(myrank, numnodes);
+
+    res->iters = doneIter;
+    res->maxdiff = MAXDIFF;
+    res->ranks = numnodes;
+    res->threads = hybrid ? opt->numThreads : 0;
+    res->isRoot = (myrank == 0);
+    if (opt->N <= opt->printLimit)
+        res->grid = gatherGrid(grid, myrank, numnodes);
+
+    freeGrid(grid);
+    MPI_Comm_free(&comm);
+    if (!initialized)
+        MPI_Finalize();
+    return 0;
+}
+
+static int runMpi(rbOptions *opt, rbResult *res)
+{
+    return runDistributed(opt, res, 0);
+}
+
+static int runHybrid(rbOptions *opt, rbResult *res)
+{
+    return runDistributed(opt, res, 1);
+}
+
+rbBackend mpiBackend = {"mpi", "one strip per MPI rank, the original dist-rb", runMpi, 1};
+rbBackend hybridBackend = {"hybrid", "MPI strips swept by OpenMP threads, the original hybrid-rb",
+                           runHybrid, 1};
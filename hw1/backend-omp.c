@@ -0,0 +1,66 @@
+#ifdef _OPENMP
+
+#include <stdio.h>
+#include <omp.h>
+#include "redblack.h"
+#include "probe.h"
+
+static int runOmp(rbOptions *opt, rbResult *res)
+{
+    int i, iters, check;
+    double startTime, maxdiff = 0.0, blackdiff;
+    rbGrid *grid = allocateGrid(opt->N, opt->N, 1, opt->layout);
+
+    omp_set_dynamic(0);
+    omp_set_num_threads(opt->numThreads);
+
+    /* Initialise with the same schedule as the sweeps so rows are first
+     * touched by the thread that updates them */
+    #pragma omp parallel for schedule(static, opt->chunkSize)
+    for (i = 0; i <= grid->height + 1; i++)
+        initRows(grid, i, i);
+
+    PROBE_INIT(1, opt->maxIters + 1);
+    PROBE_THREAD_INIT(0);
+
+    startTime = wallTime();
+    for (iters = 1; iters <= opt->maxIters + 1; iters++)
+    {
+        check = wantDiff(opt, iters);
+        PROBE_BEGIN(0);
+        if (opt->kernel == KERNEL_FUSED)
+        {
+            maxdiff = sweepFusedParallel(grid, 1, grid->height, check);
+            blackdiff = sweepEdges(grid, 1, grid->height, check);
+        }
+        else
+        {
+            maxdiff = sweepRowsParallel(grid, opt->kernel, RED, 1, grid->height,
+                                        check, opt->chunkSize);
+            blackdiff = sweepRowsParallel(grid, opt->kernel, BLACK, 1, grid->height,
+                                          check, opt->chunkSize);
+        }
+        maxdiff = MAX(maxdiff, blackdiff);
+        PROBE_END(0, PHASE_COMPUTE);
+        PROBE_ITER(0);
+        if (check && converged(opt, maxdiff))
+            break;
+    }
+    res->time = wallTime() - startTime;
+    PROBE_REPORT(0, 1);
+    PROBE_FREE();
+
+    res->iters = MIN(iters, opt->maxIters + 1);
+    res->maxdiff = maxdiff;
+    res->threads = opt->numThreads;
+    res->isRoot = 1;
+    if (opt->N <= opt->printLimit)
+        res->grid = grid;
+    else freeGrid(grid);
+
+    return 0;
+}
+
+rbBackend ompBackend = {"omp", "OpenMP parallel for over rows", runOmp, 0};
+
+#endif /* _OPENMP */
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "redblack.h"
+#include "probe.h"
+
+static rbOptions *opt;
+static rbGrid    *grid;
+static rbIo      *io;
+static rbTelemetry *tel;
+static double    *maxdiff, finalDiff, startTime, endTime;
+static int       numThreads, numRounds, finalIters, *arrive;
+
+/* Dissemination barrier: log2(numThreads) rounds of pairwise flags. The
+ * flags are accessed atomically so grid updates made before the barrier
+ * are visible after it even when the compiler optimises, and waiting
+ * threads yield so oversubscribed runs still make progress. */
+static void barrier(int id)
+{
+    int j, lookAt;
+    for (j = 1; j <= numRounds; j++)
+    {
+        while (__atomic_load_n(&arrive[id], __ATOMIC_ACQUIRE) != 0)
+            sched_yield();
+        __atomic_store_n(&arrive[id], j, __ATOMIC_RELEASE);
+        lookAt = (id + (1 << (j-1))) % numThreads;
+        while (__atomic_load_n(&arrive[lookAt], __ATOMIC_ACQUIRE) != j)
+            sched_yield();
+        __atomic_store_n(&arrive[lookAt], 0, __ATOMIC_RELEASE);
+    }
+}
+
+static void *worker(void *arg)
+{
+    int id = *((int *) arg);
+    int iters, i, firstRow, height, lastRow, check;
+    double mydiff, blackdiff, MAXDIFF = 0.0;
+
+    stripBounds(opt->N, numThreads, id, &firstRow, &height);
+    lastRow = firstRow + height - 1;
+
+    PROBE_THREAD_INIT(id);
+
+    /* Initialise my strip, the outermost strips also own the boundary rows */
+    initRows(grid, firstRow == 1 ? 0 : firstRow, lastRow == opt->N ? lastRow + 1 : lastRow);
+    applyBoundary(io, firstRow == 1 ? 0 : firstRow, lastRow == opt->N ? lastRow + 1 : lastRow);
+
+    /* Ensure that no thread moves ahead until the entire grid is initialised */
+    barrier(id);
+    if (id == 0)
+        startTime = wallTime();
+
+    for (iters = 1; iters <= opt->maxIters + 1; iters++)
+    {
+        check = wantDiff(opt, iters);
+        PROBE_BEGIN(id);
+        if (opt->kernel == KERNEL_FUSED)
+            mydiff = sweepFused(grid, firstRow, lastRow, check);
+        else mydiff = halfSweep(grid, opt->kernel, RED, firstRow, lastRow, check);
+        PROBE_END(id, PHASE_COMPUTE);
+
+        /* Sync the threads to ensure symmetric values for the black computation */
+        PROBE_BEGIN(id);
+        barrier(id);
+        PROBE_END(id, PHASE_BARRIER);
+
+        PROBE_BEGIN(id);
+        if (opt->kernel == KERNEL_FUSED)
+            blackdiff = sweepEdges(grid, firstRow, lastRow, check);
+        else blackdiff = halfSweep(grid, opt->kernel, BLACK, firstRow, lastRow, check);
+        mydiff = MAX(mydiff, blackdiff);
+        if (check)
+            maxdiff[id] = mydiff;
+        PROBE_END(id, PHASE_COMPUTE);
+
+        publishProgress(tel, id, iters, mydiff, check);
+
+        /* My rows are final for this iteration and only I write them */
+        if (snapshotDue(io, iters))
+            snapshotRows(io, iters, firstRow == 1 ? 0 : firstRow,
+                         lastRow == opt->N ? lastRow + 1 : lastRow);
+
+        /* Sync for next iteration which begins with red computation */
+        PROBE_BEGIN(id);
+        barrier(id);
+        PROBE_END(id, PHASE_BARRIER);
+        PROBE_ITER(id);
+
+        /* Every thread reduces the same values so all stop together; the
+         * slots are not rewritten until after the next red barrier */
+        if (check)
+        {
+            PROBE_BEGIN(id);
+            MAXDIFF = 0.0;
+            for (i = 0; i < numThreads; i++)
+                MAXDIFF = MAX(MAXDIFF, maxdiff[i]);
+            PROBE_END(id, PHASE_REDUCE);
+            if (converged(opt, MAXDIFF))
+                break;
+        }
+    }
+
+    /* Ensure all threads are done before the clock is stopped */
+    barrier(id);
+    if (id == 0)
+    {
+        endTime = wallTime();
+        finalIters = MIN(iters, opt->maxIters + 1);
+        finalDiff = MAXDIFF;
+    }
+    return NULL;
+}
+
+static int runPthreads(rbOptions *options, rbResult *res)
+{
+    int i, *ids;
+    pthread_t *threads;
+
+    opt = options;
+    numThreads = opt->numThreads;
+    if (numThreads > opt->N)
+    {
+        fprintf(stderr, "More threads (%d) than grid rows (%d)\n", numThreads, opt->N);
+        return 1;
+    }
+    PROBE_INIT(numThreads, opt->maxIters + 1);
+    for (numRounds = 0; (1 << numRounds) < numThreads; numRounds++);
+
+    grid = allocateGrid(opt->N, opt->N, 1, opt->layout);
+    io = startIo(opt, grid, 0, numThreads);
+    tel = startTelemetry(opt, numThreads, 0, 1);
+    maxdiff = (double *) calloc(numThreads, sizeof(double));
+    arrive  = (int *) calloc(numThreads, sizeof(int));
+    ids     = (int *) malloc(numThreads * sizeof(int));
+    threads = (pthread_t *) malloc(numThreads * sizeof(pthread_t));
+
+    // Create threads
+    for (i = 0; i < numThreads; i++)
+    {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, worker, (void *) &ids[i]);
+    }
+    for (i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+    stopIo(io);
+    stopTelemetry(tel);
+    PROBE_REPORT(0, 1);
+    PROBE_FREE();
+
+    res->time = endTime - startTime;
+    res->iters = finalIters;
+    res->maxdiff = finalDiff;
+    res->threads = numThreads;
+    res->isRoot = 1;
+    if (opt->N <= opt->printLimit)
+        res->grid = grid;
+    else freeGrid(grid);
+
+    free(maxdiff);
+    free(arrive);
+    free(ids);
+    free(threads);
+    return 0;
+}
+
+rbBackend pthreadsBackend = {"pthreads", "strip per thread with a dissemination barrier, the original mt-rb",
+                             runPthreads, 1};
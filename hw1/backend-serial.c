@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include "redblack.h"
+#include "probe.h"
+
+static int runSerial(rbOptions *opt, rbResult *res)
+{
+    int iters, check;
+    double startTime, maxdiff = 0.0, blackdiff;
+    rbGrid *grid = allocateGrid(opt->N, opt->N, 1, opt->layout);
+    rbIo *io = startIo(opt, grid, 0, 1);
+    rbTelemetry *tel = startTelemetry(opt, 1, 0, 1);
+
+    initGrid(grid);
+    applyBoundary(io, 0, grid->height + 1);
+    PROBE_INIT(1, opt->maxIters + 1);
+    PROBE_THREAD_INIT(0);
+
+    startTime = wallTime();
+    for (iters = 1; iters <= opt->maxIters + 1; iters++)
+    {
+        check = wantDiff(opt, iters);
+        PROBE_BEGIN(0);
+        if (opt->kernel == KERNEL_FUSED)
+        {
+            maxdiff = sweepFused(grid, 1, grid->height, check);
+            blackdiff = sweepEdges(grid, 1, grid->height, check);
+        }
+        else
+        {
+            maxdiff = halfSweep(grid, opt->kernel, RED, 1, grid->height, check);
+            blackdiff = halfSweep(grid, opt->kernel, BLACK, 1, grid->height, check);
+        }
+        maxdiff = MAX(maxdiff, blackdiff);
+        PROBE_END(0, PHASE_COMPUTE);
+        PROBE_ITER(0);
+        publishProgress(tel, 0, iters, maxdiff, check);
+        if (snapshotDue(io, iters))
+            snapshotRows(io, iters, 0, grid->height + 1);
+
+        if (check && converged(opt, maxdiff))
+            break;
+    }
+    res->time = wallTime() - startTime;
+    stopIo(io);
+    stopTelemetry(tel);
+    PROBE_REPORT(0, 1);
+    PROBE_FREE();
+
+    res->iters = MIN(iters, opt->maxIters + 1);
+    res->maxdiff = maxdiff;
+    res->isRoot = 1;
+    if (opt->N <= opt->printLimit)
+        res->grid = grid;
+    else freeGrid(grid);
+
+    return 0;
+}
+
+rbBackend serialBackend = {"serial", "single thread, the original seq-rb", runSerial, 1};
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "redblack.h"
+#include "probe.h"
+
+/* ================== Out-of-core streaming ================== *
+ * The grid lives in a mapped file and each pass over it does depth
+ * iterations (temporal blocking): at round s iteration d of the pass does
+ * step s - lag*d, where step i is red row i then black row i-1, the
+ * sequential update order. Iteration d only needs iteration d-1 two steps
+ * ahead, so one pass streams every row in and out once for depth
+ * iterations, holding about lag*depth rows. With several threads the lag is
+ * 3 so the steps of one round touch disjoint rows and can run together.
+ * Row blocks ahead of the window are prefetched with MADV_WILLNEED and
+ * those behind it dropped with MADV_DONTNEED. With -e the solve ends with
+ * the pass in which an iteration converges and reports its last one. */
+
+static rbOptions *opt;
+static rbGrid    *grid;
+static int       numThreads, depth, lag, blockRows, kernel, stopAt;
+static double    *iterDiff;     // max change per iteration
+static double    *passDiff;     // [thread][depth] max change in this pass
+static double    startTime, endTime;
+static pthread_barrier_t round;
+
+/* Hint rows lo..hi of the mapping, clamped to the grid */
+static void adviseRows(int lo, int hi, int advice)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t rowBytes = (size_t) grid->stride * sizeof(double);
+    char *start, *end;
+
+    lo = MAX(lo, 0);
+    hi = MIN(hi, grid->N + 1);
+    if (lo > hi)
+        return;
+    start = (char *) grid->rows[lo];
+    end = (char *) grid->rows[hi] + rowBytes;
+    // only whole pages: dropping a page shared with a live row costs a refault
+    if (advice == MADV_DONTNEED)
+    {
+        start = (char *) (((size_t) start + page - 1) / page * page);
+        end = (char *) ((size_t) end / page * page);
+    }
+    else start = (char *) ((size_t) start / page * page);
+    if (end > start)
+        madvise(start, end - start, advice);
+}
+
+static double step(int i, int check)
+{
+    double maxdiff = 0.0, rowdiff;
+
+    if (i <= grid->N)
+        maxdiff = halfSweep(grid, kernel, RED, i, i, check);
+    if (i > 1)
+    {
+        rowdiff = halfSweep(grid, kernel, BLACK, i - 1, i - 1, check);
+        maxdiff = MAX(maxdiff, rowdiff);
+    }
+    return maxdiff;
+}
+
+static void *worker(void *arg)
+{
+    int id = *((int *) arg);
+    int s, d, i, k, first, count, rounds, check, N = opt->N;
+    double rowdiff, *mine = &passDiff[id * depth];
+
+    PROBE_THREAD_INIT(id);
+
+    /* Thread 0 streams the initial grid out to the file block by block */
+    if (id == 0)
+    {
+        for (i = 0; i <= N + 1; i += blockRows)
+        {
+            initRows(grid, i, MIN(i + blockRows - 1, N + 1));
+            adviseRows(i - blockRows, i - 1, MADV_DONTNEED);
+        }
+        adviseRows(0, N + 1, MADV_DONTNEED);
+        startTime = wallTime();
+    }
+    pthread_barrier_wait(&round);
+
+    for (first = 1; first <= __atomic_load_n(&stopAt, __ATOMIC_ACQUIRE); first += depth)
+    {
+        count = MIN(depth, opt->maxIters + 2 - first);
+        rounds = N + 1 + lag * (count - 1);
+        for (d = 0; d < count; d++)
+            mine[d] = 0.0;
+
+        for (s = 1; s <= rounds; s++)
+        {
+            PROBE_BEGIN(id);
+            if (id == 0 && s % blockRows == 1 % blockRows)
+            {
+                // the leading iteration reads one row past its step
+                adviseRows(s + blockRows, s + 2 * blockRows, MADV_WILLNEED);
+                // the trailing iteration still reads the row above its step
+                adviseRows(s - lag * (count - 1) - 2 - 2 * blockRows,
+                           s - lag * (count - 1) - 2 - blockRows, MADV_DONTNEED);
+            }
+            for (d = id; d < count; d += numThreads)
+            {
+                i = s - lag * d;
+                if (i >= 1 && i <= N + 1)
+                {
+                    check = wantDiff(opt, first + d);
+                    rowdiff = step(i, check);
+                    mine[d] = MAX(mine[d], rowdiff);
+                }
+            }
+            PROBE_END(id, PHASE_COMPUTE);
+            if (numThreads > 1)
+            {
+                PROBE_BEGIN(id);
+                pthread_barrier_wait(&round);
+                PROBE_END(id, PHASE_BARRIER);
+            }
+        }
+        PROBE_ITER(id);
+
+        pthread_barrier_wait(&round);
+        if (id == 0)
+        {
+            for (d = 0; d < count; d++)
+            {
+                iterDiff[first + d] = 0.0;
+                for (k = 0; k < numThreads; k++)
+                    iterDiff[first + d] = MAX(iterDiff[first + d], passDiff[k * depth + d]);
+                // the rest of this pass is already on the grid, so stop after it
+                if (wantDiff(opt, first + d) && converged(opt, iterDiff[first + d]))
+                    __atomic_store_n(&stopAt, first + count - 1, __ATOMIC_RELEASE);
+            }
+        }
+        pthread_barrier_wait(&round);
+    }
+
+    if (id == 0)
+        endTime = wallTime();
+    return NULL;
+}
+
+static int runStream(rbOptions *options, rbResult *res)
+{
+    int i, *ids;
+    pthread_t *threads;
+
+    opt = options;
+    numThreads = opt->numThreads;
+    depth = (opt->depth > 0) ? opt->depth : 4;
+    lag = (numThreads > 1) ? 3 : 2;
+    kernel = (opt->kernel == KERNEL_FUSED) ? KERNEL_PLAIN : opt->kernel;
+    // prefetch in blocks of about 4 MB unless told otherwise
+    blockRows = (opt->tileRows > 0) ? opt->tileRows
+                                    : MAX(1, (4 << 20) / ((opt->N + 2) * (int) sizeof(double)));
+    if (opt->layout != LAYOUT_NATURAL)
+        fprintf(stderr, "The stream backend maps the grid in natural layout\n");
+
+    grid = mapGrid(opt->N, opt->gridFile);
+    madvise(grid->vals, grid->mapped, MADV_SEQUENTIAL);
+    iterDiff = (double *) calloc(opt->maxIters + 2, sizeof(double));
+    passDiff = (double *) calloc((size_t) numThreads * depth, sizeof(double));
+    stopAt = opt->maxIters + 1;
+
+    PROBE_INIT(numThreads, (opt->maxIters + depth) / depth);
+    pthread_barrier_init(&round, NULL, numThreads);
+    ids = (int *) malloc(numThreads * sizeof(int));
+    threads = (pthread_t *) malloc(numThreads * sizeof(pthread_t));
+    for (i = 0; i < numThreads; i++)
+    {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, worker, (void *) &ids[i]);
+    }
+    for (i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+    PROBE_REPORT(0, 1);
+    PROBE_FREE();
+
+    res->time = endTime - startTime;
+    res->iters = stopAt;
+    res->maxdiff = iterDiff[stopAt];
+    res->threads = numThreads;
+    res->isRoot = 1;
+    if (opt->N <= opt->printLimit)
+        res->grid = copyGrid(grid);
+    freeGrid(grid);
+
+    pthread_barrier_destroy(&round);
+    free(iterDiff);
+    free(passDiff);
+    free(ids);
+    free(threads);
+    return 0;
+}
+
+rbBackend streamBackend = {"stream", "grid in a mapped file, several iterations per pass",
+                           runStream, 0};
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "redblack.h"
+#include "probe.h"
+
+/* ================== Task-based red-black scheduling ================== *
+ * The grid is cut into bands of tileRows rows. A task is one half sweep
+ * (phase) of one band: phase p is iteration p/2+1, color p%2. Band t in
+ * phase p reads the boundary rows of bands t-1 and t+1, so it may start
+ * once bands t-1, t and t+1 have finished phase p-1. Those are the only
+ * dependencies, so there is no global barrier and a band can be several
+ * phases ahead of a distant one. Ready tasks go on the finishing thread's
+ * deque; idle threads steal from the opposite end of the others'. With -e
+ * some bands are already into later iterations when one converges, so the
+ * solve stops at the furthest iteration released so far: every band runs
+ * to it and the grid is exactly that iteration. */
+
+#define SLOTS 4     // a band is never more than 2 phases ahead of its neighbours
+
+typedef struct deque
+{
+    pthread_spinlock_t lock;
+    long *tasks;
+    int head, tail, capacity;   // owner pushes and pops at tail, thieves take head
+    char pad[64];
+} deque;
+
+static rbOptions *opt;
+static rbGrid    *grid;
+static deque     *deques;
+static int       numThreads, numTiles, tileRows, numPhases, kernel;
+static int       *pending;      // [tile][phase % SLOTS] unfinished dependencies
+static int       *iterDone;     // tasks finished per iteration
+static double    *iterDiff;     // max change per iteration
+static int       inFlight, stopAt;
+static int       reached;       // furthest iteration released to any band
+static pthread_spinlock_t gate; // orders releases against setting stopAt
+static double    startTime, endTime;
+static pthread_barrier_t start;
+
+static void push(deque *d, long task)
+{
+    pthread_spin_lock(&d->lock);
+    d->tasks[d->tail % d->capacity] = task;
+    d->tail++;
+    pthread_spin_unlock(&d->lock);
+}
+
+static int popTail(deque *d, long *task)
+{
+    int found = 0;
+    pthread_spin_lock(&d->lock);
+    if (d->tail > d->head)
+    {
+        d->tail--;
+        *task = d->tasks[d->tail % d->capacity];
+        found = 1;
+    }
+    pthread_spin_unlock(&d->lock);
+    return found;
+}
+
+static int stealHead(deque *d, long *task)
+{
+    int found = 0;
+    if (pthread_spin_trylock(&d->lock))
+        return 0;
+    if (d->tail > d->head)
+    {
+        *task = d->tasks[d->head % d->capacity];
+        d->head++;
+        found = 1;
+    }
+    pthread_spin_unlock(&d->lock);
+    return found;
+}
+
+static int dependencies(int tile)
+{
+    return 1 + (tile > 0) + (tile < numTiles - 1);
+}
+
+static void atomicMax(double *target, double value)
+{
+    double cur;
+
+    __atomic_load(target, &cur, __ATOMIC_RELAXED);
+    while (value > cur &&
+           !__atomic_compare_exchange(target, &cur, &value, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+}
+
+/* Task tile may now run phase; push it if that was its last dependency */
+static void release(int id, int tile, int phase)
+{
+    int *slot = &pending[tile * SLOTS + phase % SLOTS];
+
+    if (__atomic_sub_fetch(slot, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        __atomic_add_fetch(&inFlight, 1, __ATOMIC_ACQ_REL);
+        push(&deques[id], (long) phase * numTiles + tile);
+    }
+}
+
+/* May tasks of iteration iters be released? */
+static int admit(int iters)
+{
+    int ok;
+
+    // without a tolerance stopAt never moves
+    if (opt->tolerance <= 0)
+        return 1;
+    pthread_spin_lock(&gate);
+    ok = (iters <= stopAt);
+    if (ok)
+        reached = MAX(reached, iters);
+    pthread_spin_unlock(&gate);
+    return ok;
+}
+
+/* An iteration converged: finish the ones already under way */
+static void stop()
+{
+    pthread_spin_lock(&gate);
+    stopAt = reached;
+    pthread_spin_unlock(&gate);
+}
+
+static void runTask(int id, long task)
+{
+    int tile = task % numTiles, phase = task / numTiles;
+    int iters = phase / 2 + 1, color = phase % 2, check = wantDiff(opt, iters);
+    int lo = tile * tileRows + 1, hi = MIN(lo + tileRows - 1, opt->N), next = phase + 1;
+    double diff;
+
+    // this slot is reused four phases on, after this task has finished twice more
+    pending[tile * SLOTS + phase % SLOTS] = dependencies(tile);
+
+    diff = halfSweep(grid, kernel, color, lo, hi, check);
+    if (check)
+    {
+        atomicMax(&iterDiff[iters], diff);
+        if (__atomic_add_fetch(&iterDone[iters], 1, __ATOMIC_ACQ_REL) == 2 * numTiles
+            && converged(opt, iterDiff[iters]))
+            stop();
+    }
+
+    if (next < numPhases && admit(next / 2 + 1))
+    {
+        if (tile > 0)
+            release(id, tile - 1, next);
+        release(id, tile, next);
+        if (tile < numTiles - 1)
+            release(id, tile + 1, next);
+    }
+}
+
+static void *worker(void *arg)
+{
+    int id = *((int *) arg);
+    int i, victim, firstTile, myTiles;
+    long task;
+
+    PROBE_THREAD_INIT(id);
+
+    /* Initialise and seed my block of bands so they stay with me */
+    stripBounds(numTiles, numThreads, id, &firstTile, &myTiles);
+    firstTile--;
+    for (i = firstTile; i < firstTile + myTiles; i++)
+    {
+        initRows(grid, i == 0 ? 0 : i * tileRows + 1,
+                 i == numTiles - 1 ? opt->N + 1 : MIN((i + 1) * tileRows, opt->N));
+        push(&deques[id], i);
+    }
+
+    pthread_barrier_wait(&start);
+    if (id == 0)
+        startTime = wallTime();
+
+    victim = id;
+    while (__atomic_load_n(&inFlight, __ATOMIC_ACQUIRE) > 0)
+    {
+        PROBE_BEGIN(id);
+        if (popTail(&deques[id], &task))
+        {
+            runTask(id, task);
+            __atomic_sub_fetch(&inFlight, 1, __ATOMIC_ACQ_REL);
+            PROBE_END(id, PHASE_COMPUTE);
+            continue;
+        }
+
+        victim = (victim + 1) % numThreads;
+        if (victim != id && stealHead(&deques[victim], &task))
+        {
+            runTask(id, task);
+            __atomic_sub_fetch(&inFlight, 1, __ATOMIC_ACQ_REL);
+            PROBE_END(id, PHASE_COMPUTE);
+        }
+        else
+        {
+            sched_yield();
+            PROBE_END(id, PHASE_BARRIER);
+        }
+    }
+
+    pthread_barrier_wait(&start);
+    if (id == 0)
+        endTime = wallTime();
+    return NULL;
+}
+
+static int runTasks(rbOptions *options, rbResult *res)
+{
+    int i, *ids, iters;
+    pthread_t *threads;
+
+    opt = options;
+    numThreads = opt->numThreads;
+    kernel = (opt->kernel == KERNEL_FUSED) ? KERNEL_PLAIN : opt->kernel;
+
+    /* Default to about eight bands per thread */
+    tileRows = opt->tileRows > 0 ? opt->tileRows : MAX(1, opt->N / (8 * numThreads));
+    numTiles = (opt->N + tileRows - 1) / tileRows;
+    numPhases = 2 * (opt->maxIters + 1);
+
+    grid = allocateGrid(opt->N, opt->N, 1, opt->layout);
+    deques = (deque *) malloc(numThreads * sizeof(deque));
+    for (i = 0; i < numThreads; i++)
+    {
+        pthread_spin_init(&deques[i].lock, PTHREAD_PROCESS_PRIVATE);
+        // at most one task per band is ready at a time
+        deques[i].capacity = numTiles;
+        deques[i].tasks = (long *) malloc(numTiles * sizeof(long));
+        deques[i].head = deques[i].tail = 0;
+    }
+
+    pending = (int *) malloc(numTiles * SLOTS * sizeof(int));
+    for (i = 0; i < numTiles * SLOTS; i++)
+        pending[i] = dependencies(i / SLOTS);
+    iterDone = (int *) calloc(opt->maxIters + 2, sizeof(int));
+    iterDiff = (double *) calloc(opt->maxIters + 2, sizeof(double));
+    inFlight = numTiles;
+    stopAt = opt->maxIters + 1;
+    reached = 1;
+    pthread_spin_init(&gate, PTHREAD_PROCESS_PRIVATE);
+
+    PROBE_INIT(numThreads, 0);
+    pthread_barrier_init(&start, NULL, numThreads);
+    ids = (int *) malloc(numThreads * sizeof(int));
+    threads = (pthread_t *) malloc(numThreads * sizeof(pthread_t));
+    for (i = 0; i < numThreads; i++)
+    {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, worker, (void *) &ids[i]);
+    }
+    for (i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+    PROBE_REPORT(0, 1);
+    PROBE_FREE();
+
+    iters = stopAt;
+    res->time = endTime - startTime;
+    res->iters = iters;
+    res->maxdiff = iterDiff[iters];
+    res->threads = numThreads;
+    res->isRoot = 1;
+    if (opt->N <= opt->printLimit)
+        res->grid = grid;
+    else freeGrid(grid);
+
+    for (i = 0; i < numThreads; i++)
+    {
+        pthread_spin_destroy(&deques[i].lock);
+        free(deques[i].tasks);
+    }
+    pthread_spin_destroy(&gate);
+    pthread_barrier_destroy(&start);
+    free(deques);
+    free(pending);
+    free(iterDone);
+    free(iterDiff);
+    free(ids);
+    free(threads);
+    return 0;
+}
+
+rbBackend tasksBackend = {"tasks", "bands of rows as tasks on a work-stealing pool, no global barrier",
+                          runTasks, 0};
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "redblack.h"
+#include "probe.h"
+
+/* ================== Pipelined wavefront ================== *
+ * Thread t does iterations t+1, t+1+depth, ... so depth iterations are in
+ * flight at once, each trailing the one before it down the grid. Step i of
+ * an iteration is red row i then black row i-1 (i = 1 .. N+1), which is
+ * the same update order as a full red pass followed by a full black pass.
+ * Step i of iteration k reads black rows i-1 .. i+1 of iteration k-1, so
+ * it waits until iteration k-1 is past step i+2. Progress is published as
+ * iteration * (N+2) + step, which only ever grows. With -e the iterations
+ * behind a converged one have already written rows, so each thread keeps
+ * the rows its iteration overwrites while the one before could still
+ * converge, and those are put back at the end. */
+
+typedef struct stage
+{
+    long progress;
+    char pad[64 - sizeof(long)];
+} stage;
+
+static rbOptions *opt;
+static rbGrid    *grid;
+static stage     *stages;
+static int       depth, stepRows, kernel, lastIter;
+static double    *iterDiff;
+static rbGrid    **saved;       // [thread] rows before its iteration wrote them
+static double    startTime, endTime;
+static pthread_barrier_t start;
+
+/* Wait for iteration iters-1 to pass step; 0 if the solve stopped first */
+static int waitFor(int id, int iters, int step)
+{
+    long need = (long) (iters - 1) * (opt->N + 2) + MIN(step, opt->N + 1);
+    stage *prev = &stages[(id + depth - 1) % depth];
+
+    while (__atomic_load_n(&prev->progress, __ATOMIC_ACQUIRE) < need)
+    {
+        if (iters > __atomic_load_n(&lastIter, __ATOMIC_ACQUIRE))
+            return 0;
+        sched_yield();
+    }
+    return 1;
+}
+
+static void *worker(void *arg)
+{
+    int id = *((int *) arg);
+    int i, lo, hi, iters, check, first, height, N = opt->N;
+    double rowdiff, maxdiff, prevDiff;
+
+    PROBE_THREAD_INIT(id);
+
+    stripBounds(N, depth, id, &first, &height);
+    initRows(grid, first == 1 ? 0 : first, first + height - 1 == N ? N + 1 : first + height - 1);
+    pthread_barrier_wait(&start);
+    if (id == 0)
+        startTime = wallTime();
+
+    for (iters = id + 1; iters <= __atomic_load_n(&lastIter, __ATOMIC_ACQUIRE); iters += depth)
+    {
+        check = wantDiff(opt, iters);
+        maxdiff = 0.0;
+        for (lo = 1; lo <= N + 1; lo = hi + 1)
+        {
+            hi = MIN(lo + stepRows - 1, N + 1);
+
+            PROBE_BEGIN(id);
+            if (!waitFor(id, iters, hi + 2))
+                break;
+            PROBE_END(id, PHASE_BARRIER);
+
+            // no need once iteration iters-1 has changed too much to converge
+            __atomic_load(&iterDiff[iters - 1], &prevDiff, __ATOMIC_RELAXED);
+            if (saved != NULL && converged(opt, prevDiff))
+                for (i = lo; i <= MIN(hi, N); i++)
+                    memcpy(saved[id]->rows[i], grid->rows[i], (N + 2) * sizeof(double));
+            for (i = lo; i <= hi; i++)
+            {
+                if (i <= N)
+                {
+                    rowdiff = halfSweep(grid, kernel, RED, i, i, check);
+                    maxdiff = MAX(maxdiff, rowdiff);
+                }
+                if (i > 1)
+                {
+                    rowdiff = halfSweep(grid, kernel, BLACK, i - 1, i - 1, check);
+                    maxdiff = MAX(maxdiff, rowdiff);
+                }
+            }
+            __atomic_store(&iterDiff[iters], &maxdiff, __ATOMIC_RELAXED);
+            __atomic_store_n(&stages[id].progress, (long) iters * (N + 2) + hi, __ATOMIC_RELEASE);
+            PROBE_END(id, PHASE_COMPUTE);
+        }
+        if (lo <= N + 1)
+            break;
+        PROBE_ITER(id);
+
+        if (check && converged(opt, maxdiff))
+        {
+            // later iterations already under way stop where they are
+            // and rollBack() undoes them
+            int cur = __atomic_load_n(&lastIter, __ATOMIC_ACQUIRE);
+            while (iters < cur && !__atomic_compare_exchange_n(&lastIter, &cur, iters, 0,
+                                                              __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+        }
+    }
+
+    pthread_barrier_wait(&start);
+    if (id == 0)
+        endTime = wallTime();
+    return NULL;
+}
+
+/* Put back the rows written by the iterations after lastIter. Iteration
+ * lastIter+1 leads them and saved every row before writing it. */
+static void rollBack()
+{
+    int i, t = lastIter % depth, N = opt->N;
+    long done = stages[t].progress - (long) (lastIter + 1) * (N + 2);
+
+    for (i = 1; i <= MIN(done, N); i++)
+        memcpy(grid->rows[i], saved[t]->rows[i], (N + 2) * sizeof(double));
+}
+
+static int runWavefront(rbOptions *options, rbResult *res)
+{
+    int i, *ids;
+    pthread_t *threads;
+
+    opt = options;
+    depth = (opt->depth > 0) ? MIN(opt->depth, opt->numThreads) : opt->numThreads;
+    stepRows = (opt->tileRows > 0) ? opt->tileRows : 8;
+    kernel = (opt->kernel == KERNEL_FUSED) ? KERNEL_PLAIN : opt->kernel;
+    if (depth > opt->N)
+    {
+        fprintf(stderr, "Pipeline depth %d exceeds the %d rows\n", depth, opt->N);
+        return 1;
+    }
+
+    grid = allocateGrid(opt->N, opt->N, 1, opt->layout);
+    if (posix_memalign((void **) &stages, 64, depth * sizeof(stage)))
+    {
+        fprintf(stderr, "Unable to allocate %d pipeline stages\n", depth);
+        return 1;
+    }
+    // iteration 0 is the initial grid, complete from the start
+    for (i = 0; i < depth; i++)
+        stages[i].progress = opt->N + 1;
+    iterDiff = (double *) calloc(opt->maxIters + 2, sizeof(double));
+    lastIter = opt->maxIters + 1;
+    saved = NULL;
+    if (opt->tolerance > 0)
+    {
+        saved = (rbGrid **) malloc(depth * sizeof(rbGrid *));
+        for (i = 0; i < depth; i++)
+            saved[i] = allocateGrid(opt->N, opt->N, 1, opt->layout);
+    }
+
+    PROBE_INIT(depth, (opt->maxIters + depth) / depth);
+    pthread_barrier_init(&start, NULL, depth);
+    ids = (int *) malloc(depth * sizeof(int));
+    threads = (pthread_t *) malloc(depth * sizeof(pthread_t));
+    for (i = 0; i < depth; i++)
+    {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, worker, (void *) &ids[i]);
+    }
+    for (i = 0; i < depth; i++)
+        pthread_join(threads[i], NULL);
+    PROBE_REPORT(0, 1);
+    PROBE_FREE();
+    if (saved != NULL)
+    {
+        rollBack();
+        for (i = 0; i < depth; i++)
+            freeGrid(saved[i]);
+        free(saved);
+    }
+
+    res->time = endTime - startTime;
+    res->iters = lastIter;
+    res->maxdiff = iterDiff[lastIter];
+    res->threads = depth;
+    res->isRoot = 1;
+    if (opt->N <= opt->printLimit)
+        res->grid = grid;
+    else freeGrid(grid);
+
+    pthread_barrier_destroy(&start);
+    free(stages);
+    free(iterDiff);
+    free(ids);
+    free(threads);
+    return 0;
+}
+
+rbBackend wavefrontBackend = {"wavefront", "one iteration per thread, pipelined down the rows",
+                              runWavefront, 0};
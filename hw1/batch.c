@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include "redblack.h"
+
+#define MAX_LANES 8
+
+/* One line of the input: N MAXITERS [tolerance [boundary]] */
+typedef struct problem
+{
+    long id;
+    rbOptions opt;
+    double boundary;
+} problem;
+
+/* Up to lanes problems of the same size solved together, point (i, j) of
+ * lane l stored at vals[(i * (N+2) + j) * lanes + l] */
+typedef struct pack
+{
+    int count;
+    problem p[MAX_LANES];
+} pack;
+
+static FILE *input;
+static int lanes = 1, kernel = KERNEL_PLAIN, layout = LAYOUT_NATURAL;
+static long nextId = 0, solved = 0;
+static problem lookahead;
+static int haveLookahead = 0;
+static pthread_mutex_t readLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t writeLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Next problem from the input, skipping blank and # lines */
+static int readProblem(problem *p)
+{
+    char line[256];
+    int n;
+
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        defaultOptions(&p->opt);
+        p->boundary = 1.0;
+        n = sscanf(line, "%d %d %lf %lf", &p->opt.N, &p->opt.maxIters,
+                   &p->opt.tolerance, &p->boundary);
+        if (n < 2 || p->opt.N < 1 || p->opt.maxIters < 0)
+        {
+            fprintf(stderr, "Skipping bad problem line: %s", line);
+            continue;
+        }
+        p->id = nextId++;
+        return 1;
+    }
+    return 0;
+}
+
+/* Take up to lanes consecutive problems of one size off the input */
+static int nextPack(pack *k)
+{
+    pthread_mutex_lock(&readLock);
+    k->count = 0;
+    if (!haveLookahead)
+        haveLookahead = readProblem(&lookahead);
+    while (haveLookahead && k->count < lanes &&
+           (k->count == 0 || lookahead.opt.N == k->p[0].opt.N))
+    {
+        k->p[k->count++] = lookahead;
+        haveLookahead = readProblem(&lookahead);
+    }
+    pthread_mutex_unlock(&readLock);
+    return k->count;
+}
+
+static void report(problem *p, int iters, double maxdiff, double time)
+{
+    pthread_mutex_lock(&writeLock);
+    printf("%ld\t%d\t%d\t%lf\t%.6lf\n", p->id, p->opt.N, iters, maxdiff, time);
+    solved++;
+    pthread_mutex_unlock(&writeLock);
+}
+
+/* One problem on its own grid, the serial backend's loop */
+static void solveOne(problem *p, rbGrid **grid)
+{
+    int iters, check;
+    double startTime, maxdiff = 0.0, blackdiff;
+    rbOptions *opt = &p->opt;
+
+    if (*grid == NULL || (*grid)->N != opt->N)
+    {
+        freeGrid(*grid);
+        *grid = allocateGrid(opt->N, opt->N, 1, layout);
+    }
+
+    startTime = wallTime();
+    fillRows(*grid, 0, opt->N + 1, p->boundary);
+    for (iters = 1; iters <= opt->maxIters + 1; iters++)
+    {
+        check = wantDiff(opt, iters);
+        maxdiff = halfSweep(*grid, kernel, RED, 1, opt->N, check);
+        blackdiff = halfSweep(*grid, kernel, BLACK, 1, opt->N, check);
+        maxdiff = MAX(maxdiff, blackdiff);
+        if (check && converged(opt, maxdiff))
+            break;
+    }
+    report(p, MIN(iters, opt->maxIters + 1), maxdiff, wallTime() - startTime);
+}
+
+/* One color of every lane. Lanes that have finished keep their values,
+ * so each lane sees exactly the arithmetic of sweepRows(). */
+static inline void sweepLanes(double *vals, int N, int width, int color, double *active,
+                              double *diff)
+{
+    int i, j, l, jStart, stride = (N + 2) * width;
+    double *up, *row, *down;
+
+    for (i = 1; i <= N; i++)
+    {
+        jStart = ((i + color) % 2 == 1) ? 1 : 2;
+        for (j = jStart; j <= N; j += 2)
+        {
+            row = &vals[((size_t) i * (N + 2) + j) * width];
+            up = row - stride;
+            down = row + stride;
+
+            #pragma omp simd
+            for (l = 0; l < width; l++)
+            {
+                double old = row[l];
+                double val = (up[l] + row[l - width] + down[l] + row[l + width]) * 0.25;
+                row[l] = active[l] ? val : old;
+                diff[l] = MAX(diff[l], active[l] * fabs(val - old));
+            }
+        }
+    }
+}
+
+/* Constant widths let the compiler unroll the lane loop into vectors */
+static void sweepPack(double *vals, int N, int width, int color, double *active, double *diff)
+{
+    switch (width)
+    {
+        case 2  : sweepLanes(vals, N, 2, color, active, diff); break;
+        case 4  : sweepLanes(vals, N, 4, color, active, diff); break;
+        case 8  : sweepLanes(vals, N, 8, color, active, diff); break;
+        default : sweepLanes(vals, N, width, color, active, diff);
+    }
+}
+
+static void solvePack(pack *k, double **vals, size_t *capacity)
+{
+    int i, j, l, iters, lastIter = 0, running, N = k->p[0].opt.N, width = k->count;
+    int done[MAX_LANES], laneIters[MAX_LANES];
+    double active[MAX_LANES], diff[MAX_LANES], laneDiff[MAX_LANES], edge;
+    double startTime = wallTime();
+    size_t size = (size_t) (N + 2) * (N + 2) * width;
+
+    if (size > *capacity)
+    {
+        free(*vals);
+        *vals = (double *) malloc(size * sizeof(double));
+        *capacity = size;
+    }
+    for (i = 0; i <= N + 1; i++)
+        for (j = 0; j <= N + 1; j++)
+            for (l = 0; l < width; l++)
+            {
+                edge = (i == 0 || i == N + 1 || j == 0 || j == N + 1) ? k->p[l].boundary : 0;
+                (*vals)[((size_t) i * (N + 2) + j) * width + l] = edge;
+            }
+
+    for (l = 0; l < width; l++)
+    {
+        done[l] = 0;
+        laneDiff[l] = 0.0;
+        lastIter = MAX(lastIter, k->p[l].opt.maxIters + 1);
+    }
+
+    running = width;
+    for (iters = 1; iters <= lastIter && running > 0; iters++)
+    {
+        for (l = 0; l < width; l++)
+        {
+            active[l] = (done[l] || iters > k->p[l].opt.maxIters + 1) ? 0.0 : 1.0;
+            diff[l] = 0.0;
+        }
+        sweepPack(*vals, N, width, RED, active, diff);
+        sweepPack(*vals, N, width, BLACK, active, diff);
+
+        for (l = 0; l < width; l++)
+        {
+            if (done[l])
+                continue;
+            if (wantDiff(&k->p[l].opt, iters))
+                laneDiff[l] = diff[l];
+            if (iters == k->p[l].opt.maxIters + 1 ||
+                (wantDiff(&k->p[l].opt, iters) && converged(&k->p[l].opt, diff[l])))
+            {
+                done[l] = 1;
+                laneIters[l] = iters;
+                running--;
+                report(&k->p[l], laneIters[l], laneDiff[l], wallTime() - startTime);
+            }
+        }
+    }
+}
+
+static void *worker(void *arg)
+{
+    pack k;
+    rbGrid *grid = NULL;
+    double *vals = NULL;
+    size_t capacity = 0;
+
+    while (nextPack(&k) > 0)
+    {
+        if (k.count == 1)
+            solveOne(&k.p[0], &grid);
+        else solvePack(&k, &vals, &capacity);
+    }
+
+    freeGrid(grid);
+    free(vals);
+    return NULL;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] [file]\n"
+            "Solves each problem line 'N MAXITERS [tolerance [boundary]]' of file\n"
+            "(default stdin) and prints 'id N iters maxdiff time' as each finishes.\n"
+            "    -t <threads>  solver threads, one problem or pack each (default 1)\n"
+            "    -v <lanes>    interleave up to this many same-size problems in\n"
+            "                  SIMD lanes (1-%d, default 1)\n"
+            "    -l <layout>   natural or padded grid rows for single problems\n"
+            "    -k <kernel>   plain or simd sweep kernel for single problems\n", prog, MAX_LANES);
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, numThreads = 1;
+    double startTime, elapsed;
+    pthread_t *threads;
+
+    while ((c = getopt(argc, argv, "t:v:l:k:h")) != -1)
+    {
+        switch (c)
+        {
+            case 't' : numThreads = atoi(optarg); break;
+            case 'v' : lanes = atoi(optarg); break;
+            case 'l' : layout = parseLayout(optarg); break;
+            case 'k' : kernel = parseKernel(optarg); break;
+            default  : usage(argv[0]);
+                       exit(1);
+        }
+    }
+    if (numThreads < 1 || lanes < 1 || lanes > MAX_LANES || layout < 0 ||
+        kernel < 0 || kernel == KERNEL_FUSED || argc - optind > 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    input = stdin;
+    if (optind < argc && strcmp(argv[optind], "-") != 0)
+    {
+        input = fopen(argv[optind], "r");
+        if (input == NULL)
+        {
+            perror(argv[optind]);
+            exit(1);
+        }
+    }
+
+    printf("#id\tN\titers\tmaxdiff\ttime\n");
+    startTime = wallTime();
+    threads = (pthread_t *) malloc(numThreads * sizeof(pthread_t));
+    for (i = 0; i < numThreads; i++)
+        pthread_create(&threads[i], NULL, worker, NULL);
+    for (i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+    elapsed = wallTime() - startTime;
+
+    printf("#Solves : %ld\t#Threads : %d\t#Lanes : %d\tTime : %.3lf\tSolves/s : %.1lf\n",
+           solved, numThreads, lanes, elapsed, solved / elapsed);
+    if (input != stdin)
+        fclose(input);
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,279 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "redblack.h"
+
+#define MAX_LIST 32
+#define STRONG 0
+#define WEAK   1
+
+static char *modeNames[] = {"strong", "weak"};
+
+typedef struct benchStats
+{
+    double median, p95, min;
+} benchStats;
+
+static int myrank, numnodes;
+
+static int parseList(char *arg, int *list)
+{
+    int n = 0;
+    char *tok = strtok(arg, ",");
+    while (tok && n < MAX_LIST)
+    {
+        list[n++] = atoi(tok);
+        tok = strtok(NULL, ",");
+    }
+    return n;
+}
+
+static int parseNames(char *arg, char **list)
+{
+    int n = 0;
+    char *tok = strtok(arg, ",");
+    while (tok && n < MAX_LIST)
+    {
+        list[n++] = tok;
+        tok = strtok(NULL, ",");
+    }
+    return n;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Run warmups untimed, then trials timed runs of one configuration. Every
+ * rank takes part so MPI backends stay collective; only rank 0's times
+ * are used. Returns the iteration count of the last trial. */
+static int measure(rbBackend *backend, rbOptions *opt, int warmups, int trials,
+                   benchStats *stats)
+{
+    int k;
+    double *times = (double *) malloc(trials * sizeof(double));
+    rbResult res;
+
+    for (k = 0; k < warmups + trials; k++)
+    {
+        memset(&res, 0, sizeof(res));
+        if (backend->run(opt, &res))
+        {
+            free(times);
+            return -1;
+        }
+        if (k >= warmups)
+            times[k - warmups] = res.time;
+    }
+
+    qsort(times, trials, sizeof(double), compareDoubles);
+    stats->min = times[0];
+    stats->median = (trials % 2) ? times[trials/2]
+                                 : (times[trials/2 - 1] + times[trials/2]) / 2;
+    stats->p95 = times[(int) ceil(0.95 * trials) - 1];
+
+    free(times);
+    return res.iters;
+}
+
+/* The serial time at size N is the reference for speedup and efficiency.
+ * Rank 0 measures it alone so every launch carries its own baseline. */
+static double baseline(rbOptions *opt, int N, int warmups, int trials)
+{
+    benchStats stats;
+    rbOptions ref = *opt;
+    double t = 0.0;
+
+    if (myrank == 0)
+    {
+        ref.N = N;
+        ref.backend = "serial";
+        ref.numThreads = 1;
+        if (measure(&serialBackend, &ref, warmups, trials, &stats) > 0)
+            t = stats.median;
+    }
+    MPI_Bcast(&t, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    return t;
+}
+
+static FILE *openOutput(char *path, char *header)
+{
+    FILE *fp;
+    long size;
+
+    if (path == NULL)
+        return NULL;
+    fp = fopen(path, "a");
+    if (fp == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    if (size == 0 && header != NULL)
+        fprintf(fp, "%s\n", header);
+    return fp;
+}
+
+static void usage(char *prog)
+{
+    if (myrank == 0)
+        fprintf(stderr, "Usage: [mpirun -np <ranks>] %s [options]\n"
+                "    -b <list>     backends to measure (default serial,pthreads,omp)\n"
+                "    -n <list>     grid sizes, the per-worker base size for weak scaling\n"
+                "    -t <list>     thread counts (default 1,2,4)\n"
+                "    -i <iters>    MAXITERS per run (default 100)\n"
+                "    -w <warmups>  untimed runs per configuration (default 1)\n"
+                "    -r <trials>   timed runs per configuration (default 5)\n"
+                "    -m <mode>     strong or weak scaling (default strong)\n"
+                "    -l <layout>   natural or padded grid rows\n"
+                "    -k <kernel>   plain, simd or fused sweep kernel\n"
+                "    -o <file>     append results as CSV\n"
+                "    -j <file>     append results as JSON lines\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int c, b, s, t, iters, workers, N, mode = STRONG;
+    int sizes[MAX_LIST] = {256, 512, 1024}, numSizes = 3;
+    int threads[MAX_LIST] = {1, 2, 4}, numThreadCounts = 3;
+    int warmups = 1, trials = 5;
+    char *names[MAX_LIST] = {"serial", "pthreads", "omp"};
+    int numNames = 3;
+    char *csvPath = NULL, *jsonPath = NULL, host[64];
+    double ref, lups, glups, gbps, speedup, efficiency;
+    FILE *csv, *json;
+    rbOptions opt;
+    rbBackend *backend;
+    benchStats stats;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numnodes);
+
+    defaultOptions(&opt);
+    opt.maxIters = 100;
+
+    while ((c = getopt(argc, argv, "b:n:t:i:w:r:m:l:k:o:j:h")) != -1)
+    {
+        switch (c)
+        {
+            case 'b' : numNames = parseNames(optarg, names); break;
+            case 'n' : numSizes = parseList(optarg, sizes); break;
+            case 't' : numThreadCounts = parseList(optarg, threads); break;
+            case 'i' : opt.maxIters = atoi(optarg); break;
+            case 'w' : warmups = atoi(optarg); break;
+            case 'r' : trials = atoi(optarg); break;
+            case 'm' : mode = (strcmp(optarg, "weak") == 0) ? WEAK : STRONG; break;
+            case 'l' : opt.layout = parseLayout(optarg);
+                       if (opt.layout < 0)
+                           opt.layout = LAYOUT_NATURAL;
+                       break;
+            case 'k' : opt.kernel = parseKernel(optarg);
+                       if (opt.kernel < 0)
+                           opt.kernel = KERNEL_PLAIN;
+                       break;
+            case 'o' : csvPath = optarg; break;
+            case 'j' : jsonPath = optarg; break;
+            default  : usage(argv[0]);
+                       MPI_Finalize();
+                       exit(1);
+        }
+    }
+    if (trials < 1 || warmups < 0)
+    {
+        usage(argv[0]);
+        MPI_Finalize();
+        exit(1);
+    }
+
+    gethostname(host, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+    csv = json = NULL;
+    if (myrank == 0)
+    {
+        csv = openOutput(csvPath, "host,mode,backend,ranks,threads,workers,N,iters,"
+                         "warmups,trials,median,p95,min,glups,gbps,speedup,efficiency");
+        json = openOutput(jsonPath, NULL);
+        printf("%-8s %-9s %5s %7s %6s %10s %10s %8s %8s %8s %6s\n", "mode", "backend",
+               "ranks", "threads", "N", "median", "p95", "GLUP/s", "GB/s", "speedup", "eff");
+    }
+
+    for (s = 0; s < numSizes; s++)
+    {
+        ref = baseline(&opt, sizes[s], warmups, trials);
+
+        for (b = 0; b < numNames; b++)
+        {
+            backend = findBackend(names[b]);
+            if (backend == NULL)
+            {
+                if (myrank == 0 && s == 0)
+                    fprintf(stderr, "Skipping unknown backend '%s'\n", names[b]);
+                continue;
+            }
+            // threaded backends run on a single process only
+            if (numnodes > 1 && backend != &mpiBackend && backend != &hybridBackend)
+                continue;
+            if (checkIo(backend, &opt))
+                continue;
+
+            for (t = 0; t < numThreadCounts; t++)
+            {
+                // backends without threads are measured once per size
+                if ((backend == &serialBackend || backend == &mpiBackend) && t > 0)
+                    break;
+
+                opt.backend = backend->name;
+                opt.numThreads = (backend == &serialBackend || backend == &mpiBackend)
+                                 ? 1 : threads[t];
+                workers = opt.numThreads * numnodes;
+                N = sizes[s];
+                if (mode == WEAK)
+                    N = (int) round(sizes[s] * sqrt((double) workers));
+                opt.N = N;
+
+                iters = measure(backend, &opt, warmups, trials, &stats);
+                if (iters < 0 || myrank != 0)
+                    continue;
+
+                lups = (double) N * N * iters;
+                glups = lups / stats.median / 1e9;
+                gbps = sweepBytes(N, opt.kernel) * iters / stats.median / 1e9;
+                speedup = (mode == WEAK) ? ref * workers / stats.median : ref / stats.median;
+                efficiency = speedup / workers;
+
+                printf("%-8s %-9s %5d %7d %6d %10.5f %10.5f %8.3f %8.3f %8.2f %6.2f\n",
+                       modeNames[mode], backend->name, numnodes, opt.numThreads, N,
+                       stats.median, stats.p95, glups, gbps, speedup, efficiency);
+                if (csv)
+                    fprintf(csv, "%s,%s,%s,%d,%d,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.4f,%.4f,%.4f,%.4f\n",
+                            host, modeNames[mode], backend->name, numnodes, opt.numThreads,
+                            workers, N, iters, warmups, trials, stats.median, stats.p95,
+                            stats.min, glups, gbps, speedup, efficiency);
+                if (json)
+                    fprintf(json, "{\"host\": \"%s\", \"mode\": \"%s\", \"backend\": \"%s\", "
+                            "\"ranks\": %d, \"threads\": %d, \"workers\": %d, \"N\": %d, "
+                            "\"iters\": %d, \"warmups\": %d, \"trials\": %d, \"median\": %.6f, "
+                            "\"p95\": %.6f, \"min\": %.6f, \"glups\": %.4f, \"gbps\": %.4f, "
+                            "\"speedup\": %.4f, \"efficiency\": %.4f}\n",
+                            host, modeNames[mode], backend->name, numnodes, opt.numThreads,
+                            workers, N, iters, warmups, trials, stats.median, stats.p95,
+                            stats.min, glups, gbps, speedup, efficiency);
+            }
+        }
+    }
+
+    if (csv)
+        fclose(csv);
+    if (json)
+        fclose(json);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+#------------------------------------------------------------------------------
+# File: bench.sh
+#
+# Sweep rb-bench over MPI rank counts. Every launch appends to the same
+# CSV/JSON files, so a whole strong or weak scaling study is one call:
+#
+#   RANKS="1 2 4 8" ./bench.sh -b mpi,hybrid -n 512,1024 -t 1,2 -o scaling.csv
+#
+# RANKS defaults to "1 2 4"; MPIRUN and HOSTFILE override the launcher.
+#------------------------------------------------------------------------------
+
+RANKS=${RANKS:-"1 2 4"}
+MPIRUN=${MPIRUN:-mpirun}
+HOSTFILE=${HOSTFILE:-}
+
+for r in $RANKS
+do
+    if [ -n "$HOSTFILE" ]; then
+        $MPIRUN -np $r -hostfile $HOSTFILE ./rb-bench "$@" || exit 1
+    else
+        $MPIRUN -np $r ./rb-bench "$@" || exit 1
+    fi
+done
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "redblack.h"
+
+#define CACHE_LINE 64
+
+char *layoutNames[NUM_LAYOUTS] = {"natural", "padded"};
+
+rbGrid *allocateGrid(int N, int height, int firstRow, int layout)
+{
+    int i, gridSize = N + 2;
+    rbGrid *grid = (rbGrid *) malloc(sizeof(rbGrid));
+
+    grid->N = N;
+    grid->height = height;
+    grid->firstRow = firstRow;
+    grid->layout = layout;
+    grid->mapped = 0;
+
+    if (layout == LAYOUT_PADDED)
+    {
+        // round rows up to whole cache lines so every row starts aligned
+        grid->stride = (gridSize + CACHE_LINE/sizeof(double) - 1)
+                       / (CACHE_LINE/sizeof(double)) * (CACHE_LINE/sizeof(double));
+        if (posix_memalign((void **) &grid->vals, CACHE_LINE,
+                           (size_t) grid->stride * (height + 2) * sizeof(double)))
+            grid->vals = NULL;
+    }
+    else
+    {
+        grid->stride = gridSize;
+        grid->vals = (double *) malloc((size_t) grid->stride * (height + 2) * sizeof(double));
+    }
+
+    if (grid->vals == NULL)
+    {
+        fprintf(stderr, "Unable to allocate a %d * %d grid\n", height + 2, gridSize);
+        exit(1);
+    }
+
+    // allocate vector of pointers
+    grid->rows = (double **) malloc((height + 2) * sizeof(double *));
+    for (i = 0; i < height + 2; i++)
+        grid->rows[i] = &(grid->vals[(size_t) i * grid->stride]);
+
+    return grid;
+}
+
+/* The whole N * N grid in natural layout backed by the file at path, for
+ * grids larger than memory. Without a path an unlinked temporary file in
+ * the working directory is used, since /tmp may itself live in memory. */
+rbGrid *mapGrid(int N, char *path)
+{
+    int i, fd, gridSize = N + 2;
+    char tmpPath[] = "rb-grid.XXXXXX";
+    size_t bytes = (size_t) gridSize * gridSize * sizeof(double);
+    rbGrid *grid;
+
+    if (path != NULL)
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    else if ((fd = mkstemp(tmpPath)) >= 0)
+        unlink(tmpPath);
+    if (fd < 0 || ftruncate(fd, bytes) != 0)
+    {
+        perror(path != NULL ? path : tmpPath);
+        exit(1);
+    }
+
+    grid = (rbGrid *) malloc(sizeof(rbGrid));
+    grid->N = N;
+    grid->height = N;
+    grid->firstRow = 1;
+    grid->layout = LAYOUT_NATURAL;
+    grid->stride = gridSize;
+    grid->mapped = bytes;
+    grid->vals = (double *) mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (grid->vals == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map a %d * %d grid\n", gridSize, gridSize);
+        exit(1);
+    }
+
+    grid->rows = (double **) malloc(gridSize * sizeof(double *));
+    for (i = 0; i < gridSize; i++)
+        grid->rows[i] = &(grid->vals[(size_t) i * grid->stride]);
+
+    return grid;
+}
+
+void freeGrid(rbGrid *grid)
+{
+    if (grid == NULL)
+        return;
+    if (grid->mapped)
+        munmap(grid->vals, grid->mapped);
+    else free(grid->vals);
+    free(grid->rows);
+    free(grid);
+}
+
+/* Rows lo..hi of the initial grid: the boundary held at value, the
+ * interior at zero */
+void fillRows(rbGrid *grid, int lo, int hi, double value)
+{
+    int i, j, global, N = grid->N;
+    double edge;
+
+    for (i = lo; i <= hi; i++)
+    {
+        global = grid->firstRow + i - 1;
+        edge = (global == 0 || global == N + 1) ? value : 0;
+
+        grid->rows[i][0] = value;
+        for (j = 1; j <= N; j++)
+            grid->rows[i][j] = edge;
+        grid->rows[i][N+1] = value;
+    }
+}
+
+/* Initialise local rows lo..hi including the boundaries. Row 0 and row
+ * height+1 are the global boundary on the outermost strips and ghost rows
+ * (filled by the halo exchange) everywhere else. Threads call this on
+ * their own strip so that pages are first touched by their owner. */
+void initRows(rbGrid *grid, int lo, int hi)
+{
+    fillRows(grid, lo, hi, 1.0);
+}
+
+/* Overwrite the boundary values in local rows lo..hi with b: the top row
+ * and bottom row, N+2 doubles each, then the left and right columns, N
+ * doubles each, as laid out in a boundary file */
+void loadBoundary(rbGrid *grid, int lo, int hi, double *b)
+{
+    int i, global, N = grid->N;
+
+    for (i = lo; i <= hi; i++)
+    {
+        global = grid->firstRow + i - 1;
+        if (global == 0)
+            memcpy(grid->rows[i], b, (N + 2) * sizeof(double));
+        else if (global == N + 1)
+            memcpy(grid->rows[i], b + N + 2, (N + 2) * sizeof(double));
+        else
+        {
+            grid->rows[i][0] = b[2 * (N + 2) + global - 1];
+            grid->rows[i][N+1] = b[2 * (N + 2) + N + global - 1];
+        }
+    }
+}
+
+void initGrid(rbGrid *grid)
+{
+    initRows(grid, 0, grid->height + 1);
+}
+
+rbGrid *copyGrid(rbGrid *grid)
+{
+    int i;
+    rbGrid *copy = allocateGrid(grid->N, grid->height, grid->firstRow, grid->layout);
+
+    for (i = 0; i < grid->height + 2; i++)
+        memcpy(copy->rows[i], grid->rows[i], (grid->N + 2) * sizeof(double));
+    return copy;
+}
+
+void printGrid(rbGrid *grid)
+{
+    int i, j;
+
+    printf("\nThe %d * %d grid is\n", grid->height + 2, grid->N + 2);
+    for (i = 0; i < grid->height + 2; i++)
+    {
+        for (j = 0; j < grid->N + 2; j++)
+            printf("%lf ", grid->rows[i][j]);
+        printf("\n");
+    }
+}
+
+/* Split N interior rows into parts strips; the first N % parts strips get
+ * one extra row so no rows are dropped when N is not a multiple. */
+void stripBounds(int N, int parts, int id, int *firstRow, int *height)
+{
+    int base = N / parts, extra = N % parts;
+
+    *height = base + (id < extra ? 1 : 0);
+    *firstRow = id * base + MIN(id, extra) + 1;
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "redblack.h"
+
+/* ================== Overlapped I/O ================== *
+ * One I/O thread per process reads the boundary file while the solver
+ * allocates and initialises its grid, and writes snapshots from two
+ * buffers, so the solver only pays for copying its rows into a free
+ * buffer. Snapshots go either to one binary file per iteration, each
+ * process writing its own rows at their offset, or to one chunk file per
+ * process. Every file starts with a header of four ints:
+ *     magic, N, iteration, first global row
+ * followed by the rows, N+2 doubles each; a binary file holds rows
+ * 0..N+1, a chunk the rows of its process. */
+
+#define SNAP_MAGIC 0x52424e53   // "RBSN"
+#define SNAP_HEADER (4 * sizeof(int))
+
+#define SLOT_FREE    0
+#define SLOT_FILLING 1
+#define SLOT_FULL    2
+
+typedef struct ioSlot
+{
+    int state, iters, copied;
+    double *rows;               // own rows, N+2 doubles each
+} ioSlot;
+
+struct rbIo
+{
+    rbOptions *opt;
+    rbGrid *grid;
+    int rank, parts;
+    int ownLo, ownHi;           // local rows this process writes
+    ioSlot slots[2];
+    double *boundary;           // top row, bottom row, left and right columns
+    int loaded, stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+static void readBoundary(rbIo *io)
+{
+    int N = io->opt->N, fd = open(io->opt->boundaryFile, O_RDONLY);
+    size_t bytes = (size_t) (4 * N + 4) * sizeof(double);
+    double *values = (double *) malloc(bytes);
+
+    if (fd < 0 || read(fd, values, bytes) != (ssize_t) bytes)
+    {
+        fprintf(stderr, "Unable to read %zu bytes of boundary from %s, keeping 1\n", bytes,
+                io->opt->boundaryFile);
+        free(values);
+        values = NULL;
+    }
+    if (fd >= 0)
+        close(fd);
+
+    pthread_mutex_lock(&io->lock);
+    io->boundary = values;
+    io->loaded = 1;
+    pthread_cond_broadcast(&io->changed);
+    pthread_mutex_unlock(&io->lock);
+}
+
+static void writeSlot(rbIo *io, ioSlot *slot)
+{
+    int fd, header[4], N = io->opt->N, rows = io->ownHi - io->ownLo + 1;
+    int firstGlobal = io->grid->firstRow + io->ownLo - 1;
+    size_t rowBytes = (size_t) (N + 2) * sizeof(double);
+    off_t offset = SNAP_HEADER;
+    char path[4096];
+
+    if (io->opt->snapshotChunked)
+        snprintf(path, sizeof(path), "%s.%d.%d", io->opt->snapshotPrefix, slot->iters, io->rank);
+    else
+    {
+        snprintf(path, sizeof(path), "%s.%d.bin", io->opt->snapshotPrefix, slot->iters);
+        offset += (off_t) firstGlobal * rowBytes;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        perror(path);
+        return;
+    }
+    header[0] = SNAP_MAGIC;
+    header[1] = N;
+    header[2] = slot->iters;
+    header[3] = io->opt->snapshotChunked ? firstGlobal : 0;
+    if ((io->opt->snapshotChunked || firstGlobal == 0)
+        && pwrite(fd, header, SNAP_HEADER, 0) != SNAP_HEADER)
+        perror(path);
+    if (pwrite(fd, slot->rows, rows * rowBytes, offset) != (ssize_t) (rows * rowBytes))
+        perror(path);
+    close(fd);
+}
+
+static void *ioWorker(void *arg)
+{
+    rbIo *io = (rbIo *) arg;
+    int k;
+    ioSlot *slot;
+
+    if (io->opt->boundaryFile != NULL)
+        readBoundary(io);
+
+    pthread_mutex_lock(&io->lock);
+    for (;;)
+    {
+        slot = NULL;
+        // the older full buffer first, so snapshots land in order
+        for (k = 0; k < 2; k++)
+            if (io->slots[k].state == SLOT_FULL && (slot == NULL || io->slots[k].iters < slot->iters))
+                slot = &io->slots[k];
+        if (slot == NULL)
+        {
+            if (io->stop)
+                break;
+            pthread_cond_wait(&io->changed, &io->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&io->lock);
+
+        writeSlot(io, slot);
+
+        pthread_mutex_lock(&io->lock);
+        slot->state = SLOT_FREE;
+        pthread_cond_broadcast(&io->changed);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+/* Start the I/O thread for grid, whose rows are filled by parts threads;
+ * NULL when there is no boundary file and no snapshots */
+rbIo *startIo(rbOptions *opt, rbGrid *grid, int rank, int parts)
+{
+    int k, N = opt->N;
+    rbIo *io;
+
+    if (opt->boundaryFile == NULL && opt->snapshotEvery <= 0)
+        return NULL;
+
+    io = (rbIo *) calloc(1, sizeof(rbIo));
+    io->opt = opt;
+    io->grid = grid;
+    io->rank = rank;
+    io->parts = parts;
+    io->ownLo = (grid->firstRow == 1) ? 0 : 1;
+    io->ownHi = (grid->firstRow + grid->height - 1 == N) ? grid->height + 1 : grid->height;
+    io->loaded = (opt->boundaryFile == NULL);
+    if (opt->snapshotEvery > 0)
+        for (k = 0; k < 2; k++)
+            io->slots[k].rows = (double *) malloc((size_t) (io->ownHi - io->ownLo + 1)
+                                                  * (N + 2) * sizeof(double));
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->changed, NULL);
+    pthread_create(&io->thread, NULL, ioWorker, (void *) io);
+    return io;
+}
+
+/* Overwrite the boundary values in local rows lo..hi with those read
+ * from the boundary file, waiting for the read to finish */
+void applyBoundary(rbIo *io, int lo, int hi)
+{
+    if (io == NULL || io->opt->boundaryFile == NULL)
+        return;
+    pthread_mutex_lock(&io->lock);
+    while (!io->loaded)
+        pthread_cond_wait(&io->changed, &io->lock);
+    pthread_mutex_unlock(&io->lock);
+    if (io->boundary != NULL)
+        loadBoundary(io->grid, lo, hi, io->boundary);
+}
+
+int snapshotDue(rbIo *io, int iters)
+{
+    return io != NULL && io->opt->snapshotEvery > 0 && iters % io->opt->snapshotEvery == 0;
+}
+
+/* Copy local rows lo..hi (clamped to this process's own rows) into the
+ * buffer for iteration iters; the last of the parts callers hands it to
+ * the I/O thread. Blocks only while both buffers are still being written. */
+void snapshotRows(rbIo *io, int iters, int lo, int hi)
+{
+    int i, N = io->opt->N;
+    ioSlot *slot = &io->slots[(iters / io->opt->snapshotEvery) % 2];
+
+    pthread_mutex_lock(&io->lock);
+    while (slot->state == SLOT_FULL || (slot->state == SLOT_FILLING && slot->iters != iters))
+        pthread_cond_wait(&io->changed, &io->lock);
+    if (slot->state == SLOT_FREE)
+    {
+        slot->state = SLOT_FILLING;
+        slot->iters = iters;
+        slot->copied = 0;
+    }
+    pthread_mutex_unlock(&io->lock);
+
+    lo = MAX(lo, io->ownLo);
+    hi = MIN(hi, io->ownHi);
+    for (i = lo; i <= hi; i++)
+        memcpy(&slot->rows[(size_t) (i - io->ownLo) * (N + 2)], io->grid->rows[i],
+               (N + 2) * sizeof(double));
+
+    pthread_mutex_lock(&io->lock);
+    if (++slot->copied == io->parts)
+    {
+        slot->state = SLOT_FULL;
+        pthread_cond_broadcast(&io->changed);
+    }
+    pthread_mutex_unlock(&io->lock);
+}
+
+/* Let the pending snapshots drain and stop the I/O thread */
+void stopIo(rbIo *io)
+{
+    int k;
+
+    if (io == NULL)
+        return;
+    pthread_mutex_lock(&io->lock);
+    io->stop = 1;
+    pthread_cond_broadcast(&io->changed);
+    pthread_mutex_unlock(&io->lock);
+    pthread_join(io->thread, NULL);
+
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->changed);
+    for (k = 0; k < 2; k++)
+        free(io->slots[k].rows);
+    free(io->boundary);
+    free(io);
+}
@@ -0,0 +1,183 @@
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "redblack.h"
+
+char *kernelNames[NUM_KERNELS] = {"plain", "simd", "fused"};
+
+/* Update every point of one color in local rows lo..hi. A point (i, j) is
+ * red when i + j is even, using global row numbers so strips of any
+ * height agree on the coloring. Returns the largest change when wantDiff
+ * is set, 0 otherwise. */
+double sweepRows(rbGrid *grid, int color, int lo, int hi, int wantDiff)
+{
+    int i, j, jStart, N = grid->N;
+    double old, maxdiff = 0.0;
+    double *up, *row, *down;
+
+    for (i = lo; i <= hi; i++)
+    {
+        if ((grid->firstRow + i - 1 + color) % 2 == 1)  jStart = 1;
+            else jStart = 2;
+
+        up = grid->rows[i-1];
+        row = grid->rows[i];
+        down = grid->rows[i+1];
+
+        if (wantDiff)
+        {
+            for (j = jStart; j <= N; j += 2)
+            {
+                old = row[j];
+                row[j] = (up[j] + row[j-1] + down[j] + row[j+1]) * 0.25;
+                maxdiff = MAX(maxdiff, fabs(row[j] - old));
+            }
+        }
+        else
+        {
+            for (j = jStart; j <= N; j += 2)
+                row[j] = (up[j] + row[j-1] + down[j] + row[j+1]) * 0.25;
+        }
+    }
+
+    return maxdiff;
+}
+
+/* sweepRows() written so the compiler can vectorise the stride-2 update:
+ * a counted loop over the points of one color with an explicit max
+ * reduction. Gives bit-identical results. */
+double sweepRowsSimd(rbGrid *grid, int color, int lo, int hi, int wantDiff)
+{
+    int i, k, jStart, count, N = grid->N;
+    double maxdiff = 0.0;
+    double *up, *row, *down;
+
+    for (i = lo; i <= hi; i++)
+    {
+        jStart = ((grid->firstRow + i - 1 + color) % 2 == 1) ? 1 : 2;
+        count = (jStart <= N) ? (N - jStart) / 2 + 1 : 0;
+        up = grid->rows[i-1] + jStart;
+        row = grid->rows[i] + jStart;
+        down = grid->rows[i+1] + jStart;
+
+        if (wantDiff)
+        {
+            #pragma omp simd reduction(max:maxdiff)
+            for (k = 0; k < 2*count; k += 2)
+            {
+                double old = row[k];
+                double val = (up[k] + row[k-1] + down[k] + row[k+1]) * 0.25;
+                row[k] = val;
+                maxdiff = MAX(maxdiff, fabs(val - old));
+            }
+        }
+        else
+        {
+            #pragma omp simd
+            for (k = 0; k < 2*count; k += 2)
+                row[k] = (up[k] + row[k-1] + down[k] + row[k+1]) * 0.25;
+        }
+    }
+
+    return maxdiff;
+}
+
+double halfSweep(rbGrid *grid, int kernel, int color, int lo, int hi, int wantDiff)
+{
+    if (kernel == KERNEL_SIMD)
+        return sweepRowsSimd(grid, color, lo, hi, wantDiff);
+    return sweepRows(grid, color, lo, hi, wantDiff);
+}
+
+/* One pass over rows lo..hi doing the red half of each row and, one row
+ * behind, the black half of the row above it, so every row is streamed
+ * from memory once per iteration instead of twice. Black row i only needs
+ * red rows i-1..i+1, which are final by then. The black halves of the
+ * edge rows lo and hi depend on red rows owned by the neighbouring strip,
+ * so they are left to sweepEdges() after the caller synchronises. */
+double sweepFused(rbGrid *grid, int lo, int hi, int wantDiff)
+{
+    int i;
+    double rowdiff, maxdiff;
+
+    maxdiff = sweepRows(grid, RED, lo, lo, wantDiff);
+    for (i = lo + 1; i <= hi; i++)
+    {
+        rowdiff = sweepRows(grid, RED, i, i, wantDiff);
+        maxdiff = MAX(maxdiff, rowdiff);
+        if (i - 1 > lo)
+        {
+            rowdiff = sweepRows(grid, BLACK, i - 1, i - 1, wantDiff);
+            maxdiff = MAX(maxdiff, rowdiff);
+        }
+    }
+    return maxdiff;
+}
+
+double sweepEdges(rbGrid *grid, int lo, int hi, int wantDiff)
+{
+    double rowdiff, maxdiff = sweepRows(grid, BLACK, lo, lo, wantDiff);
+
+    if (hi > lo)
+    {
+        rowdiff = sweepRows(grid, BLACK, hi, hi, wantDiff);
+        maxdiff = MAX(maxdiff, rowdiff);
+    }
+    return maxdiff;
+}
+
+/* Same sweep with the rows shared out over an OpenMP team. Built without
+ * OpenMP this is just halfSweep(). */
+double sweepRowsParallel(rbGrid *grid, int kernel, int color, int lo, int hi,
+                         int wantDiff, int chunkSize)
+{
+    int i;
+    double rowdiff, maxdiff = 0.0;
+
+    #pragma omp parallel for private(rowdiff) reduction(max:maxdiff) schedule(static, chunkSize)
+    for (i = lo; i <= hi; i++)
+    {
+        rowdiff = halfSweep(grid, kernel, color, i, i, wantDiff);
+        maxdiff = MAX(maxdiff, rowdiff);
+    }
+
+    return maxdiff;
+}
+
+/* sweepFused() over an OpenMP team: each thread takes one contiguous
+ * block of rows, since fusing needs neighbouring rows, and the black edges
+ * between blocks are done after a team barrier. The outer edges lo and hi
+ * are still left to sweepEdges(). */
+double sweepFusedParallel(rbGrid *grid, int lo, int hi, int wantDiff)
+{
+    double maxdiff = 0.0;
+
+    #pragma omp parallel reduction(max:maxdiff)
+    {
+        int first, height, id = 0, parts = 1;
+        double rowdiff;
+#ifdef _OPENMP
+        id = omp_get_thread_num();
+        parts = omp_get_num_threads();
+#endif
+        stripBounds(hi - lo + 1, parts, id, &first, &height);
+        first += lo - 1;
+        if (height > 0)
+            maxdiff = sweepFused(grid, first, first + height - 1, wantDiff);
+
+        #pragma omp barrier
+        if (height > 0 && first > lo)
+        {
+            rowdiff = sweepRows(grid, BLACK, first, first, wantDiff);
+            maxdiff = MAX(maxdiff, rowdiff);
+        }
+        if (height > 1 && first + height - 1 < hi)
+        {
+            rowdiff = sweepRows(grid, BLACK, first + height - 1, first + height - 1, wantDiff);
+            maxdiff = MAX(maxdiff, rowdiff);
+        }
+    }
+
+    return maxdiff;
+}
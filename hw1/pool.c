@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "redblack.h"
+
+/* ================== Persistent solver ================== *
+ * The caller's thread is worker 0; the others are created once and park
+ * between solves, spinning briefly on the generation counter before they
+ * sleep on the condition variable, so back to back solves wake them
+ * without a system call. Each solve refills the same grid in place. */
+
+#define SPIN_POLLS 1000     // yields before a parked worker sleeps
+
+typedef struct poolSlot
+{
+    rbSolver *solver;
+    int id;
+    int sense;              // this worker's barrier sense, kept across solves
+    double diff;
+    char pad[64 - sizeof(rbSolver *) - 2 * sizeof(int) - sizeof(double)];
+} poolSlot;
+
+struct rbSolver
+{
+    rbOptions opt;
+    rbGrid *grid;
+    int numThreads;
+    pthread_t *threads;
+    poolSlot *slots;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int generation;         // bumped to start a solve
+    int quit;
+    int arrived, sense;
+    double *boundary;       // this solve's boundary values, NULL for all 1
+    int iters;
+    double maxdiff;
+};
+
+/* Sense-reversing barrier over the whole pool */
+static void poolBarrier(rbSolver *s, poolSlot *me)
+{
+    me->sense = !me->sense;
+    if (__atomic_add_fetch(&s->arrived, 1, __ATOMIC_ACQ_REL) == s->numThreads)
+    {
+        __atomic_store_n(&s->arrived, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->sense, me->sense, __ATOMIC_RELEASE);
+    }
+    else
+        while (__atomic_load_n(&s->sense, __ATOMIC_ACQUIRE) != me->sense)
+            sched_yield();
+}
+
+/* One solve on this worker's strip, the same steps as the pthreads backend */
+static void sweep(rbSolver *s, int id)
+{
+    int iters, check, k, first, height, last, N = s->opt.N;
+    double mydiff, blackdiff, maxdiff = 0.0;
+    rbOptions *opt = &s->opt;
+    poolSlot *me = &s->slots[id];
+
+    stripBounds(N, s->numThreads, id, &first, &height);
+    last = first + height - 1;
+    initRows(s->grid, first == 1 ? 0 : first, last == N ? N + 1 : last);
+    if (s->boundary != NULL)
+        loadBoundary(s->grid, first == 1 ? 0 : first, last == N ? N + 1 : last, s->boundary);
+    poolBarrier(s, me);
+
+    for (iters = 1; iters <= opt->maxIters + 1; iters++)
+    {
+        check = wantDiff(opt, iters);
+        if (opt->kernel == KERNEL_FUSED)
+            mydiff = sweepFused(s->grid, first, last, check);
+        else mydiff = halfSweep(s->grid, opt->kernel, RED, first, last, check);
+        poolBarrier(s, me);
+
+        if (opt->kernel == KERNEL_FUSED)
+            blackdiff = sweepEdges(s->grid, first, last, check);
+        else blackdiff = halfSweep(s->grid, opt->kernel, BLACK, first, last, check);
+        mydiff = MAX(mydiff, blackdiff);
+        if (check)
+            me->diff = mydiff;
+        poolBarrier(s, me);
+
+        if (check)
+        {
+            maxdiff = 0.0;
+            for (k = 0; k < s->numThreads; k++)
+                maxdiff = MAX(maxdiff, s->slots[k].diff);
+            if (converged(opt, maxdiff))
+                break;
+        }
+    }
+
+    if (id == 0)
+    {
+        s->iters = MIN(iters, opt->maxIters + 1);
+        s->maxdiff = maxdiff;
+    }
+    poolBarrier(s, me);
+}
+
+static void *poolWorker(void *arg)
+{
+    poolSlot *me = (poolSlot *) arg;
+    rbSolver *s = me->solver;
+    int polls, seen = 0;
+
+    for (;;)
+    {
+        for (polls = 0; polls < SPIN_POLLS &&
+             __atomic_load_n(&s->generation, __ATOMIC_ACQUIRE) == seen; polls++)
+            sched_yield();
+
+        pthread_mutex_lock(&s->lock);
+        while (s->generation == seen && !s->quit)
+            pthread_cond_wait(&s->wake, &s->lock);
+        seen = s->generation;
+        pthread_mutex_unlock(&s->lock);
+        if (s->quit)
+            return NULL;
+
+        sweep(s, me->id);
+    }
+}
+
+rbSolver *createSolver(rbOptions *opt)
+{
+    int i;
+    rbSolver *s;
+
+    if (opt->numThreads > opt->N)
+    {
+        fprintf(stderr, "More threads (%d) than grid rows (%d)\n", opt->numThreads, opt->N);
+        return NULL;
+    }
+
+    s = (rbSolver *) calloc(1, sizeof(rbSolver));
+    s->opt = *opt;
+    s->numThreads = opt->numThreads;
+    s->grid = allocateGrid(opt->N, opt->N, 1, opt->layout);
+    if (posix_memalign((void **) &s->slots, 64, s->numThreads * sizeof(poolSlot)))
+    {
+        fprintf(stderr, "Unable to allocate %d pool slots\n", s->numThreads);
+        exit(1);
+    }
+    memset(s->slots, 0, s->numThreads * sizeof(poolSlot));
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+
+    s->threads = (pthread_t *) malloc(s->numThreads * sizeof(pthread_t));
+    for (i = 0; i < s->numThreads; i++)
+    {
+        s->slots[i].solver = s;
+        s->slots[i].id = i;
+        if (i > 0)
+            pthread_create(&s->threads[i], NULL, poolWorker, (void *) &s->slots[i]);
+    }
+    return s;
+}
+
+/* Solve with the boundary held at the 4N+4 values of boundary, laid out
+ * as in a boundary file (see loadBoundary), or at 1 when it is NULL;
+ * tolerance 0 runs MAXITERS+1 sweeps. The time covers the whole call,
+ * refilling the grid included. The solution stays in solverGrid(s) until
+ * the next solve. */
+int solve(rbSolver *s, double *boundary, double tolerance, rbResult *res)
+{
+    double startTime = wallTime();
+
+    s->boundary = boundary;
+    s->opt.tolerance = tolerance;
+    if (s->numThreads > 1)
+    {
+        pthread_mutex_lock(&s->lock);
+        s->generation++;
+        pthread_cond_broadcast(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+    }
+    sweep(s, 0);
+
+    res->time = wallTime() - startTime;
+    res->iters = s->iters;
+    res->maxdiff = s->maxdiff;
+    res->threads = s->numThreads;
+    res->isRoot = 1;
+    return 0;
+}
+
+rbGrid *solverGrid(rbSolver *s)
+{
+    return s->grid;
+}
+
+void freeSolver(rbSolver *s)
+{
+    int i;
+
+    if (s == NULL)
+        return;
+    pthread_mutex_lock(&s->lock);
+    s->quit = 1;
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    for (i = 1; i < s->numThreads; i++)
+        pthread_join(s->threads[i], NULL);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    freeGrid(s->grid);
+    free(s->slots);
+    free(s->threads);
+    free(s);
+}
+
+/* As a backend the solver is kept for the next run with the same grid
+ * size, thread count and layout, e.g. the trials of rb-bench */
+static int runPool(rbOptions *opt, rbResult *res)
+{
+    static rbSolver *cached = NULL;
+
+    if (cached == NULL || cached->opt.N != opt->N || cached->numThreads != opt->numThreads
+        || cached->opt.layout != opt->layout)
+    {
+        freeSolver(cached);
+        cached = createSolver(opt);
+        if (cached == NULL)
+            return 1;
+    }
+    cached->opt.maxIters = opt->maxIters;
+    cached->opt.kernel = opt->kernel;
+
+    solve(cached, NULL, opt->tolerance, res);
+    if (opt->N <= opt->printLimit)
+        res->grid = copyGrid(solverGrid(cached));
+    return 0;
+}
+
+rbBackend poolBackend = {"pool", "persistent parked threads and grid reused across runs", runPool, 0};
@@ -0,0 +1,191 @@
+#ifdef RB_PROBE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#ifdef RB_PROBE_PERF
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "probe.h"
+
+probeWorker *probes = NULL;
+
+static int numWorkers = 0;
+static double ticksPerSec = 1.0;
+static char *phaseNames[NUM_PHASES] = {"compute", "barrier", "halo", "reduce"};
+
+/* Measure the tick rate against CLOCK_MONOTONIC over a short sleep */
+static void calibrate()
+{
+    struct timespec t0, t1, pause = {0, 20000000};
+    uint64_t c0, c1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = probeTicks();
+    nanosleep(&pause, NULL);
+    c1 = probeTicks();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    ticksPerSec = (c1 - c0) / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9);
+}
+
+void probeInit(int workers, int maxIters)
+{
+    int i, c;
+
+    probeFree();
+    if (ticksPerSec == 1.0)
+        calibrate();
+
+    numWorkers = workers;
+    if (posix_memalign((void **) &probes, 64, workers * sizeof(probeWorker)))
+    {
+        fprintf(stderr, "Unable to allocate probes for %d workers\n", workers);
+        exit(1);
+    }
+    memset(probes, 0, workers * sizeof(probeWorker));
+    for (i = 0; i < workers; i++)
+    {
+        probes[i].maxIters = maxIters;
+        probes[i].trace = (uint64_t *) calloc((size_t) maxIters * NUM_PHASES, sizeof(uint64_t));
+        for (c = 0; c < NUM_COUNTERS; c++)
+            probes[i].fds[c] = -1;
+    }
+}
+
+/* Counters follow the calling thread, so each worker opens its own */
+void probeThreadInit(int id)
+{
+#ifdef RB_PROBE_PERF
+    int c;
+    struct perf_event_attr attr;
+    unsigned long long config[NUM_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES,
+                                               PERF_COUNT_HW_CACHE_MISSES};
+
+    for (c = 0; c < NUM_COUNTERS; c++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config[c];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        probes[id].fds[c] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+double probeSeconds(uint64_t ticks)
+{
+    return ticks / ticksPerSec;
+}
+
+void probeReadCounters(int id, uint64_t *vals)
+{
+    int c;
+    for (c = 0; c < NUM_COUNTERS; c++)
+    {
+        vals[c] = 0;
+        if (probes[id].fds[c] >= 0 && read(probes[id].fds[c], &vals[c], sizeof(uint64_t)) < 0)
+            vals[c] = 0;
+    }
+}
+
+/* Print one row per worker of this process. With RB_PROBE_TRACE set, the
+ * per-iteration phase times also go to <RB_PROBE_TRACE>.<rank> as CSV. */
+void probeReport(int rank, int header)
+{
+    int i, k, p;
+    uint64_t total;
+    char *tracePath = getenv("RB_PROBE_TRACE"), *path;
+    FILE *fp;
+
+    if (header)
+    {
+        printf("\n%4s %6s", "rank", "thread");
+        for (p = 0; p < NUM_PHASES; p++)
+            printf(" %9s(s) %5s", phaseNames[p], "%");
+#ifdef RB_PROBE_PERF
+        printf(" %14s %12s %10s", "cycles", "LLC-misses", "LLC-MB");
+#endif
+        printf("\n");
+    }
+
+    for (i = 0; i < numWorkers; i++)
+    {
+        total = 0;
+        for (p = 0; p < NUM_PHASES; p++)
+            total += probes[i].ticks[p];
+        if (total == 0)
+            total = 1;
+
+        printf("%4d %6d", rank, i);
+        for (p = 0; p < NUM_PHASES; p++)
+            printf(" %12.6f %5.1f", probes[i].ticks[p] / ticksPerSec,
+                   100.0 * probes[i].ticks[p] / total);
+#ifdef RB_PROBE_PERF
+        {
+            uint64_t cycles = 0, misses = 0;
+            for (p = 0; p < NUM_PHASES; p++)
+            {
+                cycles += probes[i].counters[p][COUNTER_CYCLES];
+                misses += probes[i].counters[p][COUNTER_LLC_MISS];
+            }
+            printf(" %14llu %12llu %10.1f", (unsigned long long) cycles,
+                   (unsigned long long) misses, misses * 64 / 1e6);
+        }
+#endif
+        printf("\n");
+    }
+    fflush(stdout);
+
+    if (tracePath == NULL)
+        return;
+
+    path = (char *) malloc(strlen(tracePath) + 16);
+    sprintf(path, "%s.%d", tracePath, rank);
+    fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        perror(path);
+        free(path);
+        return;
+    }
+    fprintf(fp, "rank,thread,iter");
+    for (p = 0; p < NUM_PHASES; p++)
+        fprintf(fp, ",%s_us", phaseNames[p]);
+    fprintf(fp, "\n");
+    for (i = 0; i < numWorkers; i++)
+        for (k = 0; k < probes[i].iter && k < probes[i].maxIters; k++)
+        {
+            fprintf(fp, "%d,%d,%d", rank, i, k + 1);
+            for (p = 0; p < NUM_PHASES; p++)
+                fprintf(fp, ",%.3f", probes[i].trace[k * NUM_PHASES + p] / ticksPerSec * 1e6);
+            fprintf(fp, "\n");
+        }
+    fclose(fp);
+    free(path);
+}
+
+void probeFree()
+{
+    int i, c;
+
+    if (probes == NULL)
+        return;
+    for (i = 0; i < numWorkers; i++)
+    {
+        free(probes[i].trace);
+        for (c = 0; c < NUM_COUNTERS; c++)
+            if (probes[i].fds[c] >= 0)
+                close(probes[i].fds[c]);
+    }
+    free(probes);
+    probes = NULL;
+    numWorkers = 0;
+}
+
+#endif /* RB_PROBE */
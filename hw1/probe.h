@@ -0,0 +1,117 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+/* ================== Per-phase hot-path instrumentation ================== *
+ * Build with -DRB_PROBE (make PROBE=1) to time the phases of every
+ * iteration per thread or rank with the TSC, and additionally with
+ * -DRB_PROBE_PERF (make PROBE=perf) to read cycle and LLC miss counters
+ * through perf_event at each phase boundary. Without RB_PROBE every
+ * macro below expands to nothing. */
+
+#define PHASE_COMPUTE 0
+#define PHASE_BARRIER 1
+#define PHASE_HALO    2
+#define PHASE_REDUCE  3
+#define NUM_PHASES    4
+
+#ifdef RB_PROBE
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define COUNTER_CYCLES    0
+#define COUNTER_LLC_MISS  1
+#define NUM_COUNTERS      2
+
+typedef struct probeWorker
+{
+    uint64_t start;
+    uint64_t ticks[NUM_PHASES];             // whole solve
+    uint64_t iterTicks[NUM_PHASES];         // current iteration
+    uint64_t *trace;                        // iterTicks of every iteration
+    int iter, maxIters;
+    int fds[NUM_COUNTERS];
+    uint64_t counterStart[NUM_COUNTERS];
+    uint64_t counters[NUM_PHASES][NUM_COUNTERS];
+} __attribute__((aligned(64))) probeWorker;
+
+extern probeWorker *probes;
+
+static inline uint64_t probeTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+void probeInit(int workers, int maxIters);
+void probeThreadInit(int id);
+void probeReadCounters(int id, uint64_t *vals);
+void probeReport(int rank, int header);
+double probeSeconds(uint64_t ticks);
+void probeFree();
+
+static inline void probeBegin(int id)
+{
+#ifdef RB_PROBE_PERF
+    probeReadCounters(id, probes[id].counterStart);
+#endif
+    probes[id].start = probeTicks();
+}
+
+static inline void probeEnd(int id, int phase)
+{
+    uint64_t d = probeTicks() - probes[id].start;
+#ifdef RB_PROBE_PERF
+    int c;
+    uint64_t now[NUM_COUNTERS];
+    probeReadCounters(id, now);
+    for (c = 0; c < NUM_COUNTERS; c++)
+        probes[id].counters[phase][c] += now[c] - probes[id].counterStart[c];
+#endif
+    probes[id].ticks[phase] += d;
+    probes[id].iterTicks[phase] += d;
+}
+
+static inline void probeIter(int id)
+{
+    int p;
+    probeWorker *w = &probes[id];
+
+    for (p = 0; p < NUM_PHASES; p++)
+    {
+        if (w->iter < w->maxIters)
+            w->trace[w->iter * NUM_PHASES + p] = w->iterTicks[p];
+        w->iterTicks[p] = 0;
+    }
+    w->iter++;
+}
+
+#define PROBE_INIT(workers, iters)  probeInit(workers, iters)
+#define PROBE_THREAD_INIT(id)       probeThreadInit(id)
+#define PROBE_BEGIN(id)             probeBegin(id)
+#define PROBE_END(id, phase)        probeEnd(id, phase)
+#define PROBE_ITER(id)              probeIter(id)
+#define PROBE_REPORT(rank, header)  probeReport(rank, header)
+#define PROBE_FREE()                probeFree()
+
+#else
+
+#define PROBE_INIT(workers, iters)
+#define PROBE_THREAD_INIT(id)
+#define PROBE_BEGIN(id)
+#define PROBE_END(id, phase)
+#define PROBE_ITER(id)
+#define PROBE_REPORT(rank, header)
+#define PROBE_FREE()
+
+#endif /* RB_PROBE */
+
+#endif /* PROBE_H */
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "redblack.h"
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s -n <size> -i <MAXITERS> [options]\n"
+            "    -n <size>       dimension of the interior grid\n"
+            "    -i <MAXITERS>   maximum iterations (MAXITERS+1 sweeps are done)\n"
+            "    -e <tolerance>  stop once the largest change drops below tolerance\n"
+            "    -b <backend>    execution backend (default serial)\n"
+            "    -t <threads>    threads per process\n"
+            "    -c <chunk>      OpenMP schedule chunk size (default 10)\n"
+            "    -r <rows>       rows per task (tasks) or per pipeline step (wavefront)\n"
+            "    -d <depth>      iterations in flight (wavefront) or per pass (stream)\n"
+            "    -f <file>       file to map the grid from for the stream backend\n"
+            "    -q <bound>      error bound of the compressed store (default 1e-6)\n"
+            "    -P <0|1>        place MPI strips by node and socket (default 1)\n"
+            "    -a              autotune threads, kernel, layout, chunk, tile and depth,\n"
+            "                    caching the result in .rb-tune (or $RB_TUNE_FILE)\n"
+            "    -B <file>       read the boundary from file: top row, bottom row, left\n"
+            "                    and right columns as doubles; -B, -s and -T need the\n"
+            "                    serial, pthreads, mpi or hybrid backend\n"
+            "    -s <every>      write a snapshot every this many iterations\n"
+            "    -o <prefix>     snapshot file prefix (default snapshot)\n"
+            "    -C              one snapshot chunk per process instead of one file\n"
+            "    -T <path>       report progress to path every $RB_TELEMETRY_MS ms (default\n"
+            "                    1000), or on each connection to unix:<path>\n"
+            "    -l <layout>     natural or padded grid rows\n"
+            "    -k <kernel>     plain, simd or fused sweep kernel\n"
+            "    -p <limit>      print the final grid when size <= limit\n"
+            "Backends:\n", prog);
+    listBackends(stderr);
+}
+
+int main(int argc, char *argv[])
+{
+    int c;
+    rbOptions opt;
+
+    defaultOptions(&opt);
+    while ((c = getopt(argc, argv, "n:i:e:b:t:c:r:d:f:q:P:aB:s:o:CT:l:k:p:h")) != -1)
+    {
+        switch (c)
+        {
+            case 'n' : opt.N = atoi(optarg); break;
+            case 'i' : opt.maxIters = atoi(optarg); break;
+            case 'e' : opt.tolerance = atof(optarg); break;
+            case 'b' : opt.backend = optarg; break;
+            case 't' : opt.numThreads = atoi(optarg); break;
+            case 'c' : opt.chunkSize = atoi(optarg); break;
+            case 'r' : opt.tileRows = atoi(optarg); break;
+            case 'd' : opt.depth = atoi(optarg); break;
+            case 'f' : opt.gridFile = optarg; break;
+            case 'q' : opt.errorBound = atof(optarg); break;
+            case 'P' : opt.placeRanks = atoi(optarg); break;
+            case 'a' : opt.autotune = 1; break;
+            case 'B' : opt.boundaryFile = optarg; break;
+            case 's' : opt.snapshotEvery = atoi(optarg); break;
+            case 'o' : opt.snapshotPrefix = optarg; break;
+            case 'C' : opt.snapshotChunked = 1; break;
+            case 'T' : opt.telemetry = optarg; break;
+            case 'l' : opt.layout = parseLayout(optarg);
+                       if (opt.layout < 0)
+                       {
+                           usage(argv[0]);
+                           exit(1);
+                       }
+                       break;
+            case 'k' : opt.kernel = parseKernel(optarg);
+                       if (opt.kernel < 0)
+                       {
+                           usage(argv[0]);
+                           exit(1);
+                       }
+                       break;
+            case 'p' : opt.printLimit = atoi(optarg); break;
+            default  : usage(argv[0]);
+                       exit(1);
+        }
+    }
+
+    if (opt.N < 1 || optind != argc)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    return runSolver(&opt);
+}
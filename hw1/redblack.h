@@ -0,0 +1,157 @@
+#ifndef REDBLACK_H
+#define REDBLACK_H
+
+#include <stdio.h>
+
+#define MAX(a,b) ((a>b)? (a): (b))
+#define MIN(a,b) ((a<b)? (a): (b))
+
+#define RED   0
+#define BLACK 1
+
+/* ================== Grid layouts ================== */
+#define LAYOUT_NATURAL 0    // rows of N+2 doubles, as the original drivers used
+#define LAYOUT_PADDED  1    // rows padded and aligned to a 64-byte cache line
+#define NUM_LAYOUTS    2
+
+extern char *layoutNames[NUM_LAYOUTS];
+
+/* ================== Sweep kernels ================== */
+#define KERNEL_PLAIN 0      // the original loops
+#define KERNEL_SIMD  1      // vectorisable stride-2 loops
+#define KERNEL_FUSED 2      // red and black in one pass over the rows
+#define NUM_KERNELS  3
+
+extern char *kernelNames[NUM_KERNELS];
+
+/* A strip of the N * N interior plus its ghost/boundary rows. Threaded
+ * backends hold the whole grid (firstRow == 1, height == N); MPI ranks
+ * hold height rows starting at global row firstRow. */
+typedef struct rbGrid
+{
+    int N;              // interior dimension of the global grid
+    int height;         // interior rows held locally
+    int firstRow;       // global index of local row 1
+    int stride;         // doubles between consecutive rows
+    int layout;
+    size_t mapped;      // bytes of the file mapping behind vals, 0 if malloc'd
+    double *vals;
+    double **rows;      // rows[0] .. rows[height+1], ghost rows included
+} rbGrid;
+
+typedef struct rbOptions
+{
+    int N;
+    int maxIters;
+    double tolerance;   // 0 keeps the fixed MAXITERS+1 sweep of the old drivers
+    char *backend;
+    int numThreads;
+    int chunkSize;      // OpenMP static schedule chunk
+    int tileRows;       // rows per task or pipeline step, 0 picks one
+    int depth;          // iterations in flight (wavefront) or per pass (stream)
+    char *gridFile;     // file behind the grid for the stream backend
+    double errorBound;  // largest error the compressed store may add to a value
+    int placeRanks;     // order MPI strips so neighbours share a node
+    int autotune;       // look up or search for the fastest knobs first
+    char *boundaryFile; // boundary values to load instead of 1
+    int snapshotEvery;  // write the grid every this many iterations, 0 never
+    char *snapshotPrefix;
+    int snapshotChunked; // one file per process instead of one per snapshot
+    char *telemetry;    // progress report file, or unix:<socket path>
+    int telemetryMs;    // report file refresh period
+    int layout;
+    int kernel;
+    int printLimit;     // print the final grid when N <= printLimit
+} rbOptions;
+
+typedef struct rbResult
+{
+    int iters;
+    double maxdiff;
+    double time;
+    int ranks, threads;
+    int isRoot;         // only the root process reports
+    rbGrid *grid;       // full grid on the root when it is to be printed
+} rbResult;
+
+typedef struct rbBackend
+{
+    char *name;
+    char *description;
+    int (*run)(rbOptions *opt, rbResult *res);
+    int io;             // loads the boundary file, writes snapshots and telemetry
+} rbBackend;
+
+extern rbBackend serialBackend, pthreadsBackend, tasksBackend, wavefrontBackend;
+extern rbBackend poolBackend, streamBackend, compressedBackend, ompBackend;
+extern rbBackend mpiBackend, hybridBackend;
+extern rbBackend *backends[];
+
+/* A solver kept between solves: threads parked on a condition variable
+ * and the grid allocated once, so repeated solves pay no setup */
+typedef struct rbSolver rbSolver;
+
+/* The I/O thread of one process, see io.c */
+typedef struct rbIo rbIo;
+
+/* Progress published by the solver threads, see telemetry.c */
+typedef struct rbTelemetry rbTelemetry;
+
+/* grid.c */
+rbGrid *allocateGrid(int N, int height, int firstRow, int layout);
+rbGrid *mapGrid(int N, char *path);
+void    freeGrid(rbGrid *grid);
+void    fillRows(rbGrid *grid, int lo, int hi, double value);
+void    initRows(rbGrid *grid, int lo, int hi);
+void    loadBoundary(rbGrid *grid, int lo, int hi, double *b);
+void    initGrid(rbGrid *grid);
+rbGrid *copyGrid(rbGrid *grid);
+void    printGrid(rbGrid *grid);
+void    stripBounds(int N, int parts, int id, int *firstRow, int *height);
+
+/* kernel.c */
+double sweepRows(rbGrid *grid, int color, int lo, int hi, int wantDiff);
+double sweepRowsSimd(rbGrid *grid, int color, int lo, int hi, int wantDiff);
+double halfSweep(rbGrid *grid, int kernel, int color, int lo, int hi, int wantDiff);
+double sweepFused(rbGrid *grid, int lo, int hi, int wantDiff);
+double sweepEdges(rbGrid *grid, int lo, int hi, int wantDiff);
+double sweepRowsParallel(rbGrid *grid, int kernel, int color, int lo, int hi,
+                         int wantDiff, int chunkSize);
+double sweepFusedParallel(rbGrid *grid, int lo, int hi, int wantDiff);
+
+/* pool.c */
+rbSolver *createSolver(rbOptions *opt);
+int       solve(rbSolver *solver, double *boundary, double tolerance, rbResult *res);
+rbGrid   *solverGrid(rbSolver *solver);
+void      freeSolver(rbSolver *solver);
+
+/* io.c */
+rbIo *startIo(rbOptions *opt, rbGrid *grid, int rank, int parts);
+void  applyBoundary(rbIo *io, int lo, int hi);
+int   snapshotDue(rbIo *io, int iters);
+void  snapshotRows(rbIo *io, int iters, int lo, int hi);
+void  stopIo(rbIo *io);
+
+/* telemetry.c */
+rbTelemetry *startTelemetry(rbOptions *opt, int workers, int rank, int ranks);
+void  publishProgress(rbTelemetry *tel, int id, int iters, double residual, int check);
+void  stopTelemetry(rbTelemetry *tel);
+
+/* tune.c */
+int autotune(rbOptions *opt);
+
+/* solver.c */
+void       defaultOptions(rbOptions *opt);
+int        parseLayout(char *name);
+int        parseKernel(char *name);
+rbBackend *findBackend(char *name);
+void       listBackends(FILE *fp);
+int        checkIo(rbBackend *backend, rbOptions *opt);
+int        wantDiff(rbOptions *opt, int iters);
+int        converged(rbOptions *opt, double maxdiff);
+double     wallTime();
+double     sweepBytes(int N, int kernel);
+void       printResult(rbOptions *opt, rbResult *res);
+int        runSolver(rbOptions *opt);
+
+#endif /* REDBLACK_H */
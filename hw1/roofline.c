@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#include "redblack.h"
+
+/* 3 additions and 1 multiplication per lattice update */
+#define FLOPS_PER_LUP 4.0
+#define PEAK_LANES    32
+
+typedef struct machine
+{
+    double bandwidth;   // STREAM triad, bytes/s
+    double flops;       // FLOP/s
+} machine;
+
+typedef struct variant
+{
+    char *name;
+    char *backend;
+    int kernel;
+    int threaded;
+    int isFloat;
+} variant;
+
+static variant variants[] = {
+    {"seq",        "serial",   KERNEL_PLAIN, 0, 0},
+    {"vectorized", "serial",   KERNEL_SIMD,  0, 0},
+    {"blocked",    "serial",   KERNEL_FUSED, 0, 0},
+    {"float",      NULL,       KERNEL_PLAIN, 0, 1},
+    {"mt",         "pthreads", KERNEL_PLAIN, 1, 0},
+    {"mt-simd",    "pthreads", KERNEL_SIMD,  1, 0},
+    {"mt-blocked", "pthreads", KERNEL_FUSED, 1, 0},
+};
+#define NUM_VARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+/* STREAM triad a = b + s*c; counts 24 bytes per element like STREAM does */
+static double streamTriad(int threads, size_t n, int reps)
+{
+    size_t i;
+    int r;
+    double t, best = 1e30, s = 3.0;
+    double *a = (double *) malloc(n * sizeof(double));
+    double *b = (double *) malloc(n * sizeof(double));
+    double *c = (double *) malloc(n * sizeof(double));
+
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (i = 0; i < n; i++)
+    {
+        a[i] = 0.0;
+        b[i] = 1.0;
+        c[i] = 2.0;
+    }
+
+    for (r = 0; r < reps; r++)
+    {
+        t = wallTime();
+        #pragma omp parallel for num_threads(threads) schedule(static)
+        for (i = 0; i < n; i++)
+            a[i] = b[i] + s * c[i];
+        t = wallTime() - t;
+        best = MIN(best, t);
+    }
+
+    if (a[n/2] != 7.0)
+        fprintf(stderr, "STREAM triad check failed\n");
+    free(a);
+    free(b);
+    free(c);
+    return 3.0 * sizeof(double) * n / best;
+}
+
+/* Independent multiply-add chains held in registers, vectorised the same
+ * way as the solver kernels, so the ceiling matches what this build can
+ * issue rather than the datasheet peak. */
+static double peakFlops(int threads, long reps)
+{
+    double t, sink = 0.0;
+
+    t = wallTime();
+    #pragma omp parallel num_threads(threads) reduction(+:sink)
+    {
+        int k;
+        long r;
+        double acc[PEAK_LANES], a = 0.999999, b = 1e-7;
+
+        for (k = 0; k < PEAK_LANES; k++)
+            acc[k] = k;
+        for (r = 0; r < reps; r++)
+        {
+            #pragma omp simd
+            for (k = 0; k < PEAK_LANES; k++)
+                acc[k] = acc[k] * a + b;
+        }
+        for (k = 0; k < PEAK_LANES; k++)
+            sink += acc[k];
+    }
+    t = wallTime() - t;
+
+    if (sink == 0.0)
+        fprintf(stderr, "peak FLOP/s check failed\n");
+    return 2.0 * PEAK_LANES * reps * threads / t;
+}
+
+/* The original seq-rb loops on a single precision grid */
+static double floatSweep(int N, int iters)
+{
+    int i, j, it, jStart, gridSize = N + 2;
+    double t;
+    float *vals = (float *) malloc((size_t) gridSize * gridSize * sizeof(float));
+    float **g = (float **) malloc(gridSize * sizeof(float *));
+
+    for (i = 0; i < gridSize; i++)
+    {
+        g[i] = &vals[(size_t) i * gridSize];
+        for (j = 0; j < gridSize; j++)
+            g[i][j] = (i == 0 || i == gridSize-1 || j == 0 || j == gridSize-1) ? 1 : 0;
+    }
+
+    t = wallTime();
+    for (it = 0; it < iters; it++)
+    {
+        for (i = 1; i <= N; i++)
+        {
+            jStart = (i % 2 == 1) ? 1 : 2;
+            for (j = jStart; j <= N; j += 2)
+                g[i][j] = (g[i-1][j] + g[i][j-1] + g[i+1][j] + g[i][j+1]) * 0.25f;
+        }
+        for (i = 1; i <= N; i++)
+        {
+            jStart = (i % 2 == 1) ? 2 : 1;
+            for (j = jStart; j <= N; j += 2)
+                g[i][j] = (g[i-1][j] + g[i][j-1] + g[i+1][j] + g[i][j+1]) * 0.25f;
+        }
+    }
+    t = wallTime() - t;
+
+    free(vals);
+    free(g);
+    return t;
+}
+
+/* Size of the last level cache, 0 if the system does not say */
+static long cacheBytes()
+{
+    long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0)
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? size : 0;
+}
+
+/* STREAM arrays must be well beyond the cache to measure memory: four
+ * times the LLC, at least 64 MB, at most an eighth of physical memory */
+static long streamBytes()
+{
+    long size = MAX(4 * cacheBytes(), 64l * 1024 * 1024);
+    long limit = sysconf(_SC_PHYS_PAGES) / 8 * sysconf(_SC_PAGESIZE);
+    if (limit > 0)
+        size = MIN(size, limit);
+    return size;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+            "    -n <size>     grid size for the kernel runs (default 2048)\n"
+            "    -i <iters>    iterations per kernel run (default 50)\n"
+            "    -t <threads>  threads for the mt variants and ceilings (default all cores)\n"
+            "    -r <trials>   best of this many runs (default 3)\n"
+            "    -s <MB>       STREAM array size in MB (default 4x the LLC)\n"
+            "    -o <file>     append results as CSV\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int c, r, threads = omp_get_num_procs(), trials = 3;
+    long streamMB = streamBytes() / (1024 * 1024);
+    unsigned int k;
+    char host[64];
+    double t, best, bytes, lups, gflops, intensity, roof;
+    machine single, team, *ceiling;
+    rbOptions opt;
+    rbResult res;
+    FILE *csv = NULL;
+    char *csvPath = NULL;
+
+    defaultOptions(&opt);
+    opt.N = 2048;
+    opt.maxIters = 49;
+
+    while ((c = getopt(argc, argv, "n:i:t:r:s:o:h")) != -1)
+    {
+        switch (c)
+        {
+            case 'n' : opt.N = atoi(optarg); break;
+            case 'i' : opt.maxIters = atoi(optarg) - 1; break;
+            case 't' : threads = atoi(optarg); break;
+            case 'r' : trials = atoi(optarg); break;
+            case 's' : streamMB = atol(optarg); break;
+            case 'o' : csvPath = optarg; break;
+            default  : usage(argv[0]);
+                       exit(1);
+        }
+    }
+    if (opt.N < 1 || opt.maxIters < 0 || threads < 1 || trials < 1 || streamMB < 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    gethostname(host, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+
+    single.bandwidth = streamTriad(1, (size_t) streamMB * 1024 * 1024 / sizeof(double), 5);
+    single.flops = peakFlops(1, 20000000);
+    team.bandwidth = streamTriad(threads, (size_t) streamMB * 1024 * 1024 / sizeof(double), 5);
+    team.flops = peakFlops(threads, 20000000);
+
+    printf("Roofline for %s, N = %d, %d iterations\n", host, opt.N, opt.maxIters + 1);
+    printf("%-10s %8s %12s %12s\n", "ceiling", "threads", "STREAM GB/s", "peak GFLOP/s");
+    printf("%-10s %8d %12.2f %12.2f\n", "single", 1, single.bandwidth / 1e9, single.flops / 1e9);
+    printf("%-10s %8d %12.2f %12.2f\n\n", "team", threads, team.bandwidth / 1e9, team.flops / 1e9);
+    if (sweepBytes(opt.N, KERNEL_PLAIN) / 3 < cacheBytes())
+        printf("Note: the grid fits in the %ld MB last level cache, so sweeps can "
+               "beat the memory roof; use a larger -n\n\n", cacheBytes() / (1024 * 1024));
+
+    if (csvPath != NULL)
+    {
+        csv = fopen(csvPath, "a");
+        if (csv == NULL)
+            perror(csvPath);
+        else if (fseek(csv, 0, SEEK_END) == 0 && ftell(csv) == 0)
+            fprintf(csv, "host,variant,threads,N,iters,time,glups,gflops,intensity,"
+                    "roof_gflops,percent_roof,bound\n");
+    }
+
+    printf("%-10s %8s %10s %8s %9s %10s %11s %7s %s\n", "variant", "threads", "time(s)",
+           "GLUP/s", "GFLOP/s", "FLOP/byte", "roof GFLOP", "% roof", "bound");
+
+    for (k = 0; k < NUM_VARIANTS; k++)
+    {
+        opt.backend = variants[k].backend;
+        opt.kernel = variants[k].kernel;
+        opt.numThreads = variants[k].threaded ? threads : 1;
+        ceiling = variants[k].threaded ? &team : &single;
+
+        best = 1e30;
+        for (r = 0; r < trials; r++)
+        {
+            if (variants[k].isFloat)
+                t = floatSweep(opt.N, opt.maxIters + 1);
+            else
+            {
+                memset(&res, 0, sizeof(res));
+                if (findBackend(opt.backend)->run(&opt, &res))
+                    exit(1);
+                t = res.time;
+            }
+            best = MIN(best, t);
+        }
+
+        bytes = sweepBytes(opt.N, opt.kernel);
+        if (variants[k].isFloat)
+            bytes = bytes * sizeof(float) / sizeof(double);
+        lups = (double) opt.N * opt.N * (opt.maxIters + 1);
+        gflops = FLOPS_PER_LUP * lups / best / 1e9;
+        intensity = FLOPS_PER_LUP * opt.N * opt.N / bytes;
+        roof = MIN(ceiling->flops, intensity * ceiling->bandwidth) / 1e9;
+
+        printf("%-10s %8d %10.4f %8.3f %9.3f %10.3f %11.2f %6.1f%% %s\n", variants[k].name,
+               opt.numThreads, best, lups / best / 1e9, gflops, intensity, roof,
+               100.0 * gflops / roof,
+               intensity * ceiling->bandwidth < ceiling->flops ? "memory" : "compute");
+        if (csv)
+            fprintf(csv, "%s,%s,%d,%d,%d,%.6f,%.4f,%.4f,%.4f,%.4f,%.2f,%s\n", host,
+                    variants[k].name, opt.numThreads, opt.N, opt.maxIters + 1, best,
+                    lups / best / 1e9, gflops, intensity, roof, 100.0 * gflops / roof,
+                    intensity * ceiling->bandwidth < ceiling->flops ? "memory" : "compute");
+    }
+
+    if (csv)
+        fclose(csv);
+    return 0;
+}
@@ -1,135 +1,31 @@
 #include <stdio.h>
-#include <sys/types.h>
 #include <stdlib.h>
-#include <math.h>
-#include <sys/time.h>
+#include "redblack.h"
 
-#define MAX(a,b) ((a>b)? (a): (b))
-
-double **grid;
-int N, gridSize, MAXITERS;
-double maxdiff;
-
-double **allocateGrid() 
-{
-    int i;
-    double *vals, **temp;
-
-    // allocate values
-    vals = (double *) malloc (gridSize * gridSize * sizeof(double));
-
-    // allocate vector of pointers
-    temp = (double **) malloc (gridSize * sizeof(double*));
-
-    for(i=0; i < gridSize; i++)
-        temp[i] = &(vals[i * gridSize]);
-
-    return temp;
-}
-
-void printGrid(double **grid) 
+/* Legacy front end: seq-rb <size> <MAXITERS> [gridFile [depth]]
+ * A grid file streams the grid from disk, depth iterations per pass. */
+int main(int argc, char *argv[])
 {
-  
-    int i,j;
+    rbOptions opt;
 
-    printf("\nThe %d * %d grid is\n", gridSize, gridSize);
-    for(i=0; i < gridSize; i++)
+    if (argc < 3 || argc > 5)
     {
-        for(j=0; j < gridSize; j++)
-            printf("%lf ",  grid[i][j]);
-        printf("\n");
-    }
-}
-
-void redblack() 
-{
-    int iters, i, j, jStart;
-    double mydiff;
-
-    for (iters = 1; iters <= MAXITERS+1; iters++) 
-    {
-        for (i = 1; i <= N; i++) 
-	{
-	    if(i%2 == 1)  jStart = 1;
-	        else jStart = 2;
- 
-                       
-	    for (j = jStart; j <= N; j += 2) 
-	    {
-		if(iters == MAXITERS + 1)
-		     mydiff = grid[i][j];
-
-                grid[i][j] = (grid[i-1][j] + grid[i][j-1] +
-			     grid[i+1][j] + grid[i][j+1]) * 0.25;        
-
-	        if(iters == MAXITERS + 1)
-	            maxdiff = MAX(maxdiff, fabs(grid[i][j] - mydiff));
-	    }
-    	}
-
-	for (i = 1; i <= N; i++) 
-	{
-	    if(i%2 == 1)  jStart = 2;
-	        else jStart = 1;
-
-	    for (j = jStart; j <= N; j += 2) 
-	    {
-		if(iters == MAXITERS + 1)
-		    mydiff = grid[i][j];
-
-                grid[i][j] = (grid[i-1][j] + grid[i][j-1] +
-			     grid[i+1][j] + grid[i][j+1]) * 0.25;        
-
-	        if(iters == MAXITERS + 1)
-	            maxdiff = MAX(maxdiff, fabs(grid[i][j] - mydiff));
-	    }
-    	}
+        printf("Usage: %s <size> <MAXITERS> [gridFile [depth]]\n", argv[0]);
+        exit(1);
     }
-}
-
-
-int main(int argc, char *argv[]) 
-{
-    int i, j;
-    struct timeval tv;
-    double startTime, endTime;
 
-    if (argc != 3) 
+    defaultOptions(&opt);
+    opt.N = atoi(argv[1]);
+    opt.maxIters = atoi(argv[2]);
+    opt.backend = "serial";
+    opt.printLimit = 24;
+    if (argc >= 4)
     {
-        exit(1);
+        opt.backend = "stream";
+        opt.gridFile = argv[3];
+        if (argc == 5)
+            opt.depth = atoi(argv[4]);
     }
 
-    gettimeofday(&tv, NULL);
-    startTime = tv.tv_sec + tv.tv_usec/1000000.0;
-
-    N = atoi(argv[1]);
-    gridSize = N+2;
-
-    MAXITERS = atoi(argv[2]);
-
-    grid    = allocateGrid();
-
-    /* Initialise grid including the boundaries */
-    for (i = 0; i < gridSize; i++)
-        for (j = 0; j < gridSize; j++) 
-	{
-	    if(i == 0 || i == gridSize-1 ||
-	       j == 0 || j == gridSize-1)
-		grid[i][j] = 1;
-	    else grid[i][j] = 0;
-    	}
-
-    if (N <= 24)
-        // print matrices if relatively small
-        printGrid(grid);
-
-    redblack();
-    if (N <= 24)   // print matrix if relatively small
-        printGrid(grid);
-    
-    gettimeofday(&tv, NULL);
-    endTime = tv.tv_sec + tv.tv_usec/1000000.0;
-    printf("#MPI Ranks : 0\t#Threads : 0\tExec. Time : %.3lf\tMaxdiff : %lf\n",
-           (double)endTime - startTime, maxdiff);
-
+    return runSolver(&opt);
 }
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "redblack.h"
+
+rbBackend *backends[] = {&serialBackend, &pthreadsBackend, &tasksBackend, &wavefrontBackend,
+                         &poolBackend, &streamBackend, &compressedBackend,
+#ifdef _OPENMP
+                         &ompBackend,
+#endif
+#ifdef HAVE_MPI
+                         &mpiBackend,
+#ifdef _OPENMP
+                         &hybridBackend,
+#endif
+#endif
+                         NULL};
+
+void defaultOptions(rbOptions *opt)
+{
+    opt->N = 0;
+    opt->maxIters = 0;
+    opt->tolerance = 0.0;
+    opt->backend = "serial";
+    opt->numThreads = 1;
+    opt->chunkSize = 10;
+    opt->tileRows = 0;
+    opt->depth = 0;
+    opt->gridFile = NULL;
+    opt->errorBound = 1e-6;
+    opt->placeRanks = 1;
+    opt->autotune = 0;
+
+    /* The legacy front ends take their I/O settings from the environment */
+    opt->boundaryFile = getenv("RB_BOUNDARY");
+    opt->snapshotEvery = getenv("RB_SNAPSHOT_EVERY") ? atoi(getenv("RB_SNAPSHOT_EVERY")) : 0;
+    opt->snapshotPrefix = getenv("RB_SNAPSHOT_PREFIX") ? getenv("RB_SNAPSHOT_PREFIX") : "snapshot";
+    opt->snapshotChunked = getenv("RB_SNAPSHOT_CHUNKED") ? atoi(getenv("RB_SNAPSHOT_CHUNKED")) : 0;
+    opt->telemetry = getenv("RB_TELEMETRY");
+    opt->telemetryMs = getenv("RB_TELEMETRY_MS") ? atoi(getenv("RB_TELEMETRY_MS")) : 1000;
+    opt->layout = LAYOUT_NATURAL;
+    opt->kernel = KERNEL_PLAIN;
+    opt->printLimit = 0;
+}
+
+int parseLayout(char *name)
+{
+    int i;
+    for (i = 0; i < NUM_LAYOUTS; i++)
+        if (strcmp(name, layoutNames[i]) == 0)
+            return i;
+    return -1;
+}
+
+int parseKernel(char *name)
+{
+    int i;
+    for (i = 0; i < NUM_KERNELS; i++)
+        if (strcmp(name, kernelNames[i]) == 0)
+            return i;
+    return -1;
+}
+
+rbBackend *findBackend(char *name)
+{
+    int i;
+    for (i = 0; backends[i] != NULL; i++)
+        if (strcmp(name, backends[i]->name) == 0)
+            return backends[i];
+    return NULL;
+}
+
+void listBackends(FILE *fp)
+{
+    int i;
+    for (i = 0; backends[i] != NULL; i++)
+        fprintf(fp, "    %-10s %s\n", backends[i]->name, backends[i]->description);
+}
+
+/* 1, after saying so, if opt asks backend for I/O it does not do. The
+ * options may come from the environment, so they are never just dropped. */
+int checkIo(rbBackend *backend, rbOptions *opt)
+{
+    if (backend->io || (opt->boundaryFile == NULL && opt->snapshotEvery <= 0
+                        && (opt->telemetry == NULL || *opt->telemetry == '\0')))
+        return 0;
+    fprintf(stderr, "The %s backend does not support a boundary file, snapshots or telemetry "
+            "(-B, -s, -T or RB_BOUNDARY, RB_SNAPSHOT_EVERY, RB_TELEMETRY); "
+            "use serial, pthreads, mpi or hybrid\n", backend->name);
+    return 1;
+}
+
+/* Without a tolerance the solvers keep the old behaviour: MAXITERS+1
+ * iterations, measuring the change only during the last one. With a
+ * tolerance every iteration is measured so the loop can stop early. */
+int wantDiff(rbOptions *opt, int iters)
+{
+    return opt->tolerance > 0 || iters == opt->maxIters + 1;
+}
+
+int converged(rbOptions *opt, double maxdiff)
+{
+    return opt->tolerance > 0 && maxdiff < opt->tolerance;
+}
+
+double wallTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1000000000.0;
+}
+
+/* Minimum memory traffic of one full iteration: each half sweep streams
+ * the whole grid in and writes back the half it updated. The fused kernel
+ * streams the grid in only once. */
+double sweepBytes(int N, int kernel)
+{
+    double gridSize = N + 2;
+    int passes = (kernel == KERNEL_FUSED) ? 1 : 2;
+    return (passes * gridSize * gridSize + (double) N * N) * sizeof(double);
+}
+
+void printResult(rbOptions *opt, rbResult *res)
+{
+    printf("#MPI Ranks : %d\t#Threads : %d\tExec. Time : %.3lf\tMaxdiff : %lf",
+           res->ranks, res->threads, res->time, res->maxdiff);
+    if (opt->tolerance > 0)
+        printf("\tIters : %d", res->iters);
+    printf("\n");
+}
+
+int runSolver(rbOptions *opt)
+{
+    rbResult res;
+    rbBackend *backend = findBackend(opt->backend);
+
+    if (backend == NULL)
+    {
+        fprintf(stderr, "Unknown backend '%s', available backends are:\n", opt->backend);
+        listBackends(stderr);
+        return 1;
+    }
+    if (opt->N < 1 || opt->maxIters < 0 || opt->numThreads < 1)
+    {
+        fprintf(stderr, "Grid size and thread count must be positive\n");
+        return 1;
+    }
+    if (checkIo(backend, opt))
+        return 1;
+
+    if (opt->autotune && autotune(opt))
+        return 1;
+
+    memset(&res, 0, sizeof(res));
+    if (backend->run(opt, &res))
+        return 1;
+
+    if (res.isRoot)
+    {
+        if (res.grid != NULL)
+            printGrid(res.grid);
+        printResult(opt, &res);
+    }
+    freeGrid(res.grid);
+    return 0;
+}
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "redblack.h"
+#include "probe.h"
+
+/* ================== Progress telemetry ================== *
+ * Each solver thread owns one slot and publishes its iteration count,
+ * latest residual and elapsed phase times into it under a seqlock: the
+ * writer makes the sequence odd, stores and makes it even again, so the
+ * hot loop never waits and never takes a lock. A side thread reads the
+ * slots, retrying a slot whose sequence moved, and either rewrites a
+ * report file every telemetryMs milliseconds or, for a path given as
+ * unix:<path>, answers each connection on that socket with one report.
+ * Phase times need a probe build (make PROBE=1). */
+
+typedef struct telemetryData
+{
+    int iters;
+    int measured;               // residual known, it is only computed on checked iterations
+    double residual;
+    double elapsed;             // seconds since the solve started
+    double lastIter;            // seconds taken by the latest iteration
+    double phases[NUM_PHASES];
+} telemetryData;
+
+typedef struct telemetrySlot
+{
+    unsigned seq;
+    telemetryData data;
+} __attribute__((aligned(64))) telemetrySlot;
+
+struct rbTelemetry
+{
+    rbOptions *opt;
+    int workers, rank;
+    telemetrySlot *slots;
+    double startTime;
+    char path[4096];
+    int listenFd;               // -1 when writing a file
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/* Copy one slot, retrying until no write overlapped the copy */
+static void readSlot(telemetrySlot *slot, telemetryData *out)
+{
+    unsigned before, after;
+
+    for (;;)
+    {
+        before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            sched_yield();
+            continue;
+        }
+        memcpy(out, &slot->data, sizeof(telemetryData));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        if (before == after)
+            return;
+    }
+}
+
+static void writeReport(rbTelemetry *tel, FILE *fp)
+{
+    int i, p, iters = -1, measured = 0;
+    double residual = 0.0, rate;
+    telemetryData d;
+    char *phaseNames[NUM_PHASES] = {"compute", "barrier", "halo", "reduce"};
+
+    fprintf(fp, "# backend %s N %d rank %d workers %d elapsed %.3f\n", tel->opt->backend,
+            tel->opt->N, tel->rank, tel->workers, wallTime() - tel->startTime);
+    fprintf(fp, "%6s %8s %12s %10s %10s", "worker", "iters", "residual", "iters/s", "last(s)");
+    for (p = 0; p < NUM_PHASES; p++)
+        fprintf(fp, " %10s", phaseNames[p]);
+    fprintf(fp, "\n");
+    for (i = 0; i < tel->workers; i++)
+    {
+        readSlot(&tel->slots[i], &d);
+        rate = (d.elapsed > 0.0) ? d.iters / d.elapsed : 0.0;
+        fprintf(fp, "%6d %8d ", i, d.iters);
+        if (d.measured)
+            fprintf(fp, "%12.6f", d.residual);
+        else fprintf(fp, "%12s", "-");
+        fprintf(fp, " %10.1f %10.6f", rate, d.lastIter);
+        for (p = 0; p < NUM_PHASES; p++)
+#ifdef RB_PROBE
+            fprintf(fp, " %10.4f", d.phases[p]);
+#else
+            fprintf(fp, " %10s", "-");
+#endif
+        fprintf(fp, "\n");
+
+        // the slowest worker and the largest residual are the grid's
+        iters = (iters < 0) ? d.iters : MIN(iters, d.iters);
+        if (d.measured)
+        {
+            residual = MAX(residual, d.residual);
+            measured = 1;
+        }
+    }
+    fprintf(fp, "%6s %8d ", "all", MAX(iters, 0));
+    if (measured)
+        fprintf(fp, "%12.6f\n", residual);
+    else fprintf(fp, "%12s\n", "-");
+}
+
+/* Write the report beside the file and rename it over, so readers never
+ * see half a report */
+static void writeFile(rbTelemetry *tel)
+{
+    char tmp[4096 + 8];
+    FILE *fp;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", tel->path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL)
+        return;
+    writeReport(tel, fp);
+    fclose(fp);
+    rename(tmp, tel->path);
+}
+
+static void serveClient(rbTelemetry *tel)
+{
+    int fd = accept(tel->listenFd, NULL, NULL);
+    FILE *fp;
+
+    if (fd < 0)
+        return;
+    fp = fdopen(fd, "w");
+    if (fp == NULL)
+    {
+        close(fd);
+        return;
+    }
+    writeReport(tel, fp);
+    fclose(fp);
+}
+
+static void *telemetryWorker(void *arg)
+{
+    rbTelemetry *tel = (rbTelemetry *) arg;
+    struct pollfd pfd;
+    struct timespec until;
+    double wake;
+
+    if (tel->listenFd >= 0)
+    {
+        pfd.fd = tel->listenFd;
+        pfd.events = POLLIN;
+        while (!__atomic_load_n(&tel->stop, __ATOMIC_ACQUIRE))
+            if (poll(&pfd, 1, 100) > 0)
+                serveClient(tel);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&tel->lock);
+    while (!tel->stop)
+    {
+        pthread_mutex_unlock(&tel->lock);
+        writeFile(tel);
+        pthread_mutex_lock(&tel->lock);
+
+        clock_gettime(CLOCK_REALTIME, &until);
+        wake = until.tv_sec + until.tv_nsec / 1e9 + tel->opt->telemetryMs / 1e3;
+        until.tv_sec = (time_t) wake;
+        until.tv_nsec = (long) ((wake - until.tv_sec) * 1e9);
+        while (!tel->stop && pthread_cond_timedwait(&tel->changed, &tel->lock, &until) != ETIMEDOUT);
+    }
+    pthread_mutex_unlock(&tel->lock);
+    // leave the final state behind
+    writeFile(tel);
+    return NULL;
+}
+
+static int listenOn(char *path)
+{
+    int fd;
+    struct sockaddr_un addr;
+
+    // a truncated path would be bound, and later unlinked, in its place
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path %s is longer than %zu bytes\n", path,
+                sizeof(addr.sun_path) - 1);
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Start the side thread for workers publishing threads of one process;
+ * ranks above 1 give every rank its own file or socket. NULL when
+ * telemetry is off. */
+rbTelemetry *startTelemetry(rbOptions *opt, int workers, int rank, int ranks)
+{
+    rbTelemetry *tel;
+    char *target = opt->telemetry;
+    int unixSocket;
+
+    if (target == NULL || *target == '\0')
+        return NULL;
+    unixSocket = (strncmp(target, "unix:", 5) == 0);
+    if (unixSocket)
+        target += 5;
+
+    tel = (rbTelemetry *) calloc(1, sizeof(rbTelemetry));
+    tel->opt = opt;
+    tel->workers = workers;
+    tel->rank = rank;
+    tel->listenFd = -1;
+    if (ranks > 1)
+        snprintf(tel->path, sizeof(tel->path), "%s.%d", target, rank);
+    else snprintf(tel->path, sizeof(tel->path), "%s", target);
+    if (unixSocket && (tel->listenFd = listenOn(tel->path)) < 0)
+    {
+        free(tel);
+        return NULL;
+    }
+    if (posix_memalign((void **) &tel->slots, 64, workers * sizeof(telemetrySlot)))
+    {
+        fprintf(stderr, "Unable to allocate telemetry for %d workers\n", workers);
+        exit(1);
+    }
+    memset(tel->slots, 0, workers * sizeof(telemetrySlot));
+    tel->startTime = wallTime();
+    pthread_mutex_init(&tel->lock, NULL);
+    pthread_cond_init(&tel->changed, NULL);
+    pthread_create(&tel->thread, NULL, telemetryWorker, (void *) tel);
+    return tel;
+}
+
+/* Publish worker id's state after iteration iters; residual counts only
+ * when check says it was computed */
+void publishProgress(rbTelemetry *tel, int id, int iters, double residual, int check)
+{
+    telemetrySlot *slot;
+    telemetryData *d;
+    double now, elapsed;
+    unsigned seq;
+
+    if (tel == NULL)
+        return;
+    slot = &tel->slots[id];
+    d = &slot->data;
+    now = wallTime();
+    elapsed = now - tel->startTime;
+
+    seq = slot->seq;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    d->lastIter = elapsed - d->elapsed;
+    d->elapsed = elapsed;
+    d->iters = iters;
+    if (check)
+    {
+        d->residual = residual;
+        d->measured = 1;
+    }
+#ifdef RB_PROBE
+    {
+        int p;
+        for (p = 0; p < NUM_PHASES; p++)
+            d->phases[p] = probeSeconds(probes[id].ticks[p]);
+    }
+#endif
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Stop the side thread, leaving a final report in file mode */
+void stopTelemetry(rbTelemetry *tel)
+{
+    if (tel == NULL)
+        return;
+    pthread_mutex_lock(&tel->lock);
+    __atomic_store_n(&tel->stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&tel->changed);
+    pthread_mutex_unlock(&tel->lock);
+    pthread_join(tel->thread, NULL);
+
+    if (tel->listenFd >= 0)
+    {
+        close(tel->listenFd);
+        unlink(tel->path);
+    }
+    pthread_mutex_destroy(&tel->lock);
+    pthread_cond_destroy(&tel->changed);
+    free(tel->slots);
+    free(tel);
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "redblack.h"
+
+/* ================== Autotuning ================== *
+ * The first run of a backend at size N on a given kind of node times
+ * short trial solves, tuning one knob at a time (thread count, kernel,
+ * layout, then the backend's own chunk, tile or depth) and keeping the
+ * fastest value of each. The result is appended to the tuning file and
+ * reused by later runs on the same node type. MPI backends are not
+ * tuned, since a trial would have to initialise and finalise MPI. */
+
+#define TUNE_FILE   ".rb-tune"
+#define TUNE_ITERS  20          // sweeps per trial
+#define TUNE_TRIALS 2           // best of this many runs per candidate
+
+static char *tunePath()
+{
+    char *path = getenv("RB_TUNE_FILE");
+    return path != NULL ? path : TUNE_FILE;
+}
+
+/* CPU model and online core count, with no spaces */
+static void nodeType(char *buf, int size)
+{
+    char line[256], *model = NULL, *c;
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+
+    snprintf(buf, size, "unknown");
+    while (fp != NULL && fgets(line, sizeof(line), fp) != NULL)
+        if (strncmp(line, "model name", 10) == 0 && (model = strchr(line, ':')) != NULL)
+        {
+            model += 2;
+            model[strcspn(model, "\n")] = '\0';
+            snprintf(buf, size, "%s", model);
+            break;
+        }
+    if (fp != NULL)
+        fclose(fp);
+
+    snprintf(buf + strlen(buf), size - strlen(buf), "x%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    for (c = buf; *c; c++)
+        if (*c == ' ' || *c == '\t')
+            *c = '_';
+}
+
+/* Fill opt from the tuning file; 1 if an entry matched */
+static int loadTuning(rbOptions *opt, char *node)
+{
+    char line[512], entryNode[256], entryBackend[64];
+    int N, threads, chunk, tile, depth, layout, kernel, found = 0;
+    FILE *fp = fopen(tunePath(), "r");
+
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%255s %d %63s %d %d %d %d %d %d", entryNode, &N, entryBackend,
+                   &threads, &chunk, &tile, &depth, &layout, &kernel) != 9)
+            continue;
+        if (N != opt->N || strcmp(entryNode, node) != 0 || strcmp(entryBackend, opt->backend) != 0
+            || layout < 0 || layout >= NUM_LAYOUTS || kernel < 0 || kernel >= NUM_KERNELS)
+            continue;
+        // later entries win, so a retune only needs appending
+        opt->numThreads = threads;
+        opt->chunkSize = chunk;
+        opt->tileRows = tile;
+        opt->depth = depth;
+        opt->layout = layout;
+        opt->kernel = kernel;
+        found = 1;
+    }
+    fclose(fp);
+    return found;
+}
+
+static void saveTuning(rbOptions *opt, char *node, double time)
+{
+    FILE *fp = fopen(tunePath(), "a");
+
+    if (fp == NULL)
+    {
+        perror(tunePath());
+        return;
+    }
+    if (fseek(fp, 0, SEEK_END) == 0 && ftell(fp) == 0)
+        fprintf(fp, "# node N backend threads chunk tile depth layout kernel trial_seconds\n");
+    fprintf(fp, "%s %d %s %d %d %d %d %d %d %.6f\n", node, opt->N, opt->backend,
+            opt->numThreads, opt->chunkSize, opt->tileRows, opt->depth, opt->layout,
+            opt->kernel, time);
+    fclose(fp);
+}
+
+static double trial(rbBackend *backend, rbOptions *opt)
+{
+    int k;
+    double best = 1e30;
+    rbOptions run = *opt;
+    rbResult res;
+
+    run.maxIters = MIN(opt->maxIters, TUNE_ITERS - 1);
+    run.tolerance = 0.0;
+    run.printLimit = 0;
+    // trials neither load the boundary nor write snapshots and reports
+    run.boundaryFile = NULL;
+    run.snapshotEvery = 0;
+    run.telemetry = NULL;
+    for (k = 0; k < TUNE_TRIALS; k++)
+    {
+        memset(&res, 0, sizeof(res));
+        if (backend->run(&run, &res))
+            return 1e30;
+        best = MIN(best, res.time);
+    }
+    return best;
+}
+
+/* Try each value for one knob of best, keeping the fastest */
+static void tuneKnob(rbBackend *backend, rbOptions *best, double *bestTime, int *knob,
+                     int *values, int count)
+{
+    int k, keep = *knob;
+    double t;
+
+    for (k = 0; k < count; k++)
+    {
+        if (values[k] == keep)
+            continue;
+        *knob = values[k];
+        t = trial(backend, best);
+        if (t < *bestTime)
+        {
+            *bestTime = t;
+            keep = values[k];
+        }
+    }
+    *knob = keep;
+}
+
+static int isBackend(rbOptions *opt, char *names)
+{
+    char list[128], *tok;
+
+    snprintf(list, sizeof(list), "%s", names);
+    for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ","))
+        if (strcmp(tok, opt->backend) == 0)
+            return 1;
+    return 0;
+}
+
+/* Tune opt in place for its backend and size */
+int autotune(rbOptions *opt)
+{
+    int k, count, values[32], maxThreads;
+    int layouts[NUM_LAYOUTS] = {LAYOUT_NATURAL, LAYOUT_PADDED};
+    int kernels[NUM_KERNELS] = {KERNEL_PLAIN, KERNEL_SIMD, KERNEL_FUSED};
+    int chunks[] = {1, 4, 10, 32, 128}, tiles[] = {4, 8, 16, 32, 64, 128};
+    int depths[] = {1, 2, 4, 8, 16};
+    char node[256];
+    double bestTime;
+    rbBackend *backend = findBackend(opt->backend);
+
+    if (backend == NULL || !isBackend(opt, "serial,pthreads,tasks,wavefront,pool,omp,stream"))
+    {
+        fprintf(stderr, "Autotuning does not cover the %s backend\n", opt->backend);
+        return 0;
+    }
+
+    nodeType(node, sizeof(node));
+    if (loadTuning(opt, node))
+    {
+        fprintf(stderr, "Using the tuned %s configuration from %s\n", opt->backend, tunePath());
+        return 0;
+    }
+
+    fprintf(stderr, "Tuning %s for N = %d on %s ...\n", opt->backend, opt->N, node);
+    bestTime = trial(backend, opt);
+    if (bestTime >= 1e30)
+        return 1;
+
+    if (!isBackend(opt, "serial"))
+    {
+        maxThreads = MIN(MAX(opt->numThreads, sysconf(_SC_NPROCESSORS_ONLN)), opt->N);
+        for (count = 0, k = 1; k <= maxThreads && count < 32; k *= 2)
+            values[count++] = k;
+        tuneKnob(backend, opt, &bestTime, &opt->numThreads, values, count);
+    }
+    // the row-at-a-time backends have no fused kernel
+    tuneKnob(backend, opt, &bestTime, &opt->kernel, kernels,
+             isBackend(opt, "tasks,wavefront,stream") ? 2 : NUM_KERNELS);
+    if (!isBackend(opt, "stream"))
+        tuneKnob(backend, opt, &bestTime, &opt->layout, layouts, NUM_LAYOUTS);
+
+    if (isBackend(opt, "omp"))
+    {
+        for (count = 0, k = 0; k < (int) (sizeof(chunks) / sizeof(int)); k++)
+            if (chunks[k] <= opt->N)
+                values[count++] = chunks[k];
+        tuneKnob(backend, opt, &bestTime, &opt->chunkSize, values, count);
+    }
+    if (isBackend(opt, "tasks,wavefront,stream"))
+    {
+        for (count = 0, k = 0; k < (int) (sizeof(tiles) / sizeof(int)); k++)
+            if (tiles[k] <= opt->N)
+                values[count++] = tiles[k];
+        tuneKnob(backend, opt, &bestTime, &opt->tileRows, values, count);
+    }
+    if (isBackend(opt, "stream"))
+        tuneKnob(backend, opt, &bestTime, &opt->depth, depths, sizeof(depths) / sizeof(int));
+
+    fprintf(stderr, "Tuned: threads %d, kernel %s, layout %s, chunk %d, tile %d, depth %d "
+            "(%.6f s per %d sweeps)\n", opt->numThreads, kernelNames[opt->kernel],
+            layoutNames[opt->layout], opt->chunkSize, opt->tileRows, opt->depth, bestTime,
+            MIN(opt->maxIters + 1, TUNE_ITERS));
+    saveTuning(opt, node, bestTime);
+    return 0;
+}
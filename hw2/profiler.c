@@ -3,6 +3,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* MPI-3 made the send buffers const */
+#if MPI_VERSION >= 3
+#define MPI3_CONST const
+#else
+#define MPI3_CONST
+#endif
 
 #ifndef _EXTERN_C_
 #ifdef __cplusplus
@@ -34,10 +48,6 @@ _EXTERN_C_ void pmpi_init__(MPI_Fint *ierr);
  * Global per-node data structures and constants                    *
  * **************************************************************** */
 
-#define PLUS "+"
-// White space characters fail at tokenizer 
-#define FOUR_SPACES " "
-
 /* ================== Constants for MPI Operations ================== */
 #define _MPI_INIT_       0
 #define _MPI_SEND_       1
@@ -52,266 +62,535 @@ _EXTERN_C_ void pmpi_init__(MPI_Fint *ierr);
 #define _MPI_WAIT_      10
 #define _MPI_WAITALL_   11
 #define _MPI_ALLTOALL_  12
-#define _MPI_FINALIZE_  13
-#define _NUM_MPI_OPS_   14
+#define _MPI_WAITANY_   13
+#define _MPI_WAITSOME_  14
+#define _MPI_TEST_      15
+#define _MPI_TESTALL_   16
+#define _MPI_TESTANY_   17
+#define _MPI_TESTSOME_  18
+#define _MPI_FINALIZE_  19
+#define _NUM_MPI_OPS_   20
 #define _NUM_COLLECTIVES_ 6
 #define _NUM_UNCOLLECTIVES_ 6
 
-char* collectives[_NUM_COLLECTIVES_] = {"MPI_Barrier", "MPI_Scatter", 
-                                        "MPI_Gather" , "MPI_Reduce", 
-                                        "MPI_Alltoall","MPI_Allreduce"};
+int collectives[_NUM_COLLECTIVES_] = {_MPI_BARRIER_, _MPI_SCATTER_, 
+                                      _MPI_GATHER_, _MPI_REDUCE_, 
+                                      _MPI_ALLTOALL_, _MPI_ALLREDUCE_};
 
 char* mpiOpNames[_NUM_MPI_OPS_] = {"MPI_Init", "MPI_Send", "MPI_Recv",
                                    "MPI_Isend", "MPI_Irecv", "MPI_Barrier",
                                    "MPI_Scatter", "MPI_Gather", "MPI_Reduce",
                                    "MPI_Allreduce", "MPI_Wait", "MPI_Waitall",
-                                   "MPI_Alltoall", "MPI_Finalize"};
-
-#define WHITE 0
-#define GRAY  1
-#define BLACK 2
-
-typedef struct times
-{
-    int t;
-    struct times *next;
-}times;
-
-times *mpiOpTimes[_NUM_MPI_OPS_];
-int stats[_NUM_MPI_OPS_][5];
-
-struct opCountNode
+                                   "MPI_Alltoall", "MPI_Waitany", "MPI_Waitsome",
+                                   "MPI_Test", "MPI_Testall", "MPI_Testany",
+                                   "MPI_Testsome", "MPI_Finalize"};
+
+#define DOT_GRAPH_LIMIT 100000   // events beyond which no dot graph is drawn
+
+/* ================== Call statistics ================== *
+ * Per MPI call, and per message size class for the point-to-point calls,
+ * each rank keeps the count, sum, min and max of its call times and a
+ * log-linear histogram: values below 2^HIST_SUB_BITS get a bucket each,
+ * larger ones 2^HIST_SUB_BITS buckets per power of two, so a quantile
+ * read back is within about 6% in constant memory. Times are counted in
+ * ticks and turned into ns at MPI_Finalize, where a user-defined
+ * MPI_Reduce operator merges every rank's table on rank 0. */
+#define HIST_SUB_BITS    4
+#define HIST_MAX_EXP     40     // larger values share the top bucket
+#define HIST_BUCKETS     ((HIST_MAX_EXP - HIST_SUB_BITS + 2) << HIST_SUB_BITS)
+#define NUM_SIZE_CLASSES 6
+
+typedef struct opStats
 {
-    int tag, count;
-    struct opCountNode *next;
-};
-
-typedef struct opCount
+    uint64_t count, sum, min, max;
+    uint64_t buckets[HIST_BUCKETS];
+} opStats;
+
+// class 0 counts every call, class c + 1 the messages of size class c
+opStats callStats[_NUM_MPI_OPS_][NUM_SIZE_CLASSES + 1];
+char *sizeClassNames[NUM_SIZE_CLASSES] = {"<=64", "<=1K", "<=16K", "<=256K", "<=4M", ">4M"};
+
+/* ================== Per-rank event buffer ================== *
+ * Every intercepted call appends one fixed-size record to a preallocated
+ * buffer. A full buffer is written to this rank's spill file in one block,
+ * so the application never waits on a formatted write. At MPI_Finalize
+ * each rank reads its own spill back and the traces are gathered on rank
+ * 0, which builds the graph in memory; no rank reads another's files. */
+#define EVENT_BUFFER_SIZE 65536
+
+typedef struct eventRecord
 {
-    struct opCountNode *head;
-}opCount;
-
-opCount **opSeqCount;
+    int op;                 // one of the _MPI_*_ constants
+    int peer;               // world rank of a send's destination or a receive's source
+    int tag, comm;          // comm is the communicator's id, -1 for completions
+    int seq;                // seq numbers the calls with the same op, peer, tag and comm
+    int waitsOn;            // the Isend/Irecv event a wait completes, -1 otherwise
+    long int bytes;
+    uint64_t start, end;    // ticks around the PMPI call, ns on rank 0's clock once aligned
+} eventRecord;
 
-typedef struct vertexMetaData
-{
-    char *key;
-    char *interTreeChild;
-} vertexMetaData;
+eventRecord *events;
+int numBuffered = 0, numFlushed = 0;
+FILE *eventFile = NULL;
 
-typedef struct adjList
+typedef struct graphEdge
 {
     int src;
     int dest;
     long int weight;
     long int bytes;
-    int isCritical;
-    struct adjList* next;
-} adjList;
- 
-adjList *path = NULL, *criticalPath = NULL;
+    int isMessage;
+} graphEdge;
 
+/* A vertex is identified by (op, comm, fromRank, toRank, tag, opSeq): a
+ * send and its receive share the last five, and every rank's copy of a
+ * collective shares all six */
 typedef struct graphVertex
 {
-    char *key;
-    char *sendTarget;
-    char *recvTarget;
-    char *opName;
+    int op, comm;
     int fromRank, toRank;
     int tag, opSeq;
-    int inTreeWeight, interTreeWeight;
+    int waitsOn;            // for a wait, the vertex of the request it completes
+    long int inTreeWeight;  // ns since the end of the rank's previous call
+    uint64_t start, end;
     long int bytes;
-    int parent, Sv, color;
-    int d, f;
     int id;
-    adjList *root;
-        
 } graphVertex;
 
+/* Compressed sparse rows: the edges out of vertex v are
+ * edges[firstEdge[v]] up to edges[firstEdge[v+1]-1] */
 typedef struct graph
 {
-    int numGraphVertices;
+    int numGraphVertices, numEdges;
     graphVertex *vertexListArray;
+    int *firstEdge;
+    graphEdge *edges;
 } graph; 
 
-struct llist
+/* Open addressing index of vertices by their key; slots hold vertex + 1 */
+typedef struct matchIndex
 {
-    int vertex;
-    struct llist *next;
-}*root = NULL, *front = NULL, *rear = NULL;
-
-struct requestList
+    int size;
+    int *slots;
+} matchIndex;
+
+/* ================== Outstanding requests ================== *
+ * Open addressing on the value of the request handle, which stays put
+ * until the request completes. Completion removes the entry, so a handle
+ * value the library gives out again starts afresh. Handles are read
+ * before the PMPI call, which sets completed ones to MPI_REQUEST_NULL. */
+#define REQUEST_HANDLES 16      // handles kept on the stack per call
+
+typedef struct requestSlot
 {
-    char *waitingOn;
-    MPI_Request *request;
-    int visited;
-    struct requestList *next;
-} *requestHead = NULL;
+    uint64_t handle;
+    int event;              // the Isend/Irecv event, -1 for an empty slot
+} requestSlot;
+
+requestSlot *requestTable = NULL;
+int requestTableSize = 0, numRequests = 0;
+
+/* ================== Sequence numbers ================== *
+ * The n-th call with a given op, peer, tag and communicator gets seq n,
+ * so the n-th send from A to B matches the n-th receive at B from A.
+ * Sends and receives of either kind count under _MPI_SEND_ and
+ * _MPI_RECV_. Peers are world ranks and communicators their ids below. */
+typedef struct seqSlot
+{
+    int op, peer, tag, comm;
+    int seq;                // calls so far, 0 for an empty slot
+} seqSlot;
+
+seqSlot *seqTable = NULL;
+int seqTableSize = 0, numSeqKeys = 0;
+
+/* ================== Communicator ids ================== *
+ * Handles are local to a process, so a communicator is keyed by an id all
+ * its members agree on: WORLD_COMM_ID, SELF_COMM_ID, or for one made by a
+ * wrapped constructor below, an id its rank 0 hands out and broadcasts at
+ * creation. The id and the world rank of each member are kept in an
+ * attribute, which MPI frees with the communicator. Traffic on any other
+ * communicator, an intercommunicator say, is recorded with id and peer -1
+ * and never matched, and only collectives on MPI_COMM_WORLD are shared
+ * by every rank's trace. */
+#define WORLD_COMM_ID 0
+#define SELF_COMM_ID  1
+
+typedef struct commInfo
+{
+    int id;
+    int *worldRank;         // world rank of each rank of the communicator
+} commInfo;
 
-MPI_Request *curRequest = NULL; 
+int commKeyval = MPI_KEYVAL_INVALID, numCommIds = 0;
+MPI_Group worldGroup;
 
 int myRank, numNodes;
 FILE *fin, *fout;
 char *baseFileName = "tmp", *fileName;
 
-double startTime, endTime, discoveryTime, stime, etime;
+uint64_t stime, etime;
 double globalEndTime = 0;
 
-int totalOps = 0, *numVertices, numCollectives = 0;
+int totalOps = 0, *numVertices;
 graphVertex **keys;
 graph *Graph;
-int numGraphVertices, *rankOffsetInMatrix, pathLength = 0;
+int numGraphVertices, *rankOffsetInMatrix, **vertexOf, *criticalEdge;
 
-long int *distTo;
-adjList **edgeTo;
+/* ================== End of Constants for MPI Operations ================== */
 
-char *lastParentKey;
+int histBucket(uint64_t v)
+{
+    int e;
+
+    if(v < (1ull << HIST_SUB_BITS))
+        return (int)v;
+    e = 63 - __builtin_clzll(v);
+    if(e > HIST_MAX_EXP)
+        return HIST_BUCKETS - 1;
+    return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + 
+           (int)((v >> (e - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
 
-/* ================== End of Constants for MPI Operations ================== */
+/* The middle of bucket b */
+uint64_t histValue(int b)
+{
+    int e;
+    uint64_t low;
+
+    if(b < (1 << HIST_SUB_BITS))
+        return b;
+    e = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    low = (1ull << e) + ((uint64_t)(b & ((1 << HIST_SUB_BITS) - 1)) << (e - HIST_SUB_BITS));
+    return low + (1ull << (e - HIST_SUB_BITS)) / 2;
+}
 
-void insert(times **timeroot, int t)
+int sizeClass(long int bytes)
 {
-    times *new = (times*)malloc(sizeof(times));
-    new->t = t;
-    new->next = *timeroot;
-    *timeroot = new;
+    int c = 0;
+    long int limit = 64;
+
+    for(; c < NUM_SIZE_CLASSES - 1 && bytes > limit; c++)
+        limit *= 16;
+    return c;
 }
 
-adjList* newAdjListNode(int dest, long int weight, long int bytes)
+void addToStats(opStats *s, uint64_t v)
 {
-    adjList* new = (adjList*) malloc(sizeof(adjList));
-    new->dest = dest;
-    new->weight = weight;
-    new->bytes = bytes;
-    new->next = NULL;
-    return new;
-} 
+    if(s->count == 0 || v < s->min)
+        s->min = v;
+    if(v > s->max)
+        s->max = v;
+    s->count++;
+    s->sum += v;
+    s->buckets[histBucket(v)]++;
+}
 
-graph* createGraph(int numGraphVertices)
+/* Count one call of mpiOp taking ticks; bytes only for messages */
+void addStat(int mpiOp, long int bytes, uint64_t ticks)
+{
+    addToStats(&callStats[mpiOp][0], ticks);
+    if(bytes >= 0)
+        addToStats(&callStats[mpiOp][1 + sizeClass(bytes)], ticks);
+}
+
+/* A graph of numGraphVertices vertices with room for maxEdges edges */
+graph* createGraph(int numGraphVertices, int maxEdges)
 {
     int i;
 
     graph* Graph = (graph*) malloc(sizeof(graph));
     Graph->numGraphVertices = numGraphVertices;
+    Graph->numEdges = 0;
  
     Graph->vertexListArray = (graphVertex*) malloc(numGraphVertices * sizeof(graphVertex));
+    Graph->firstEdge = (int*) calloc(numGraphVertices + 1, sizeof(int));
+    Graph->edges = (graphEdge*) malloc((maxEdges > 0 ? maxEdges : 1) * sizeof(graphEdge));
  
     for (i = 0; i < numGraphVertices; ++i)
-    {
-        Graph->vertexListArray[i].root = NULL;
-        Graph->vertexListArray[i].key = Graph->vertexListArray[i].opName = NULL;
-        Graph->vertexListArray[i].recvTarget = NULL;
         Graph->vertexListArray[i].id = i;
-    }
  
     return Graph;
 }
  
-void addEdge(graph* Graph, int src, int dest, long int weight, long int bytes)
+/* Edges are appended in any order; compressGraph() sorts them into rows */
+void addEdge(graph* Graph, int src, int dest, long int weight, long int bytes, 
+             int isMessage)
 {
-    adjList* new = newAdjListNode(dest, weight, bytes);
-    new->src = src;
-    new->isCritical = 0;
-    new->next = Graph->vertexListArray[src].root;
-    Graph->vertexListArray[src].root = new; 
+    graphEdge *e = &Graph->edges[Graph->numEdges++];
+
+    e->src = src;
+    e->dest = dest;
+    e->weight = weight;
+    e->bytes = bytes;
+    e->isMessage = isMessage;
+}
+
+/* Counting sort of the edges by source, keeping each row in the order
+ * its edges were added */
+void compressGraph(graph *Graph)
+{
+    int i, v, *next;
+    graphEdge *sorted;
+
+    for(i = 0; i < Graph->numEdges; i++)
+        Graph->firstEdge[Graph->edges[i].src + 1]++;
+    for(v = 0; v < Graph->numGraphVertices; v++)
+        Graph->firstEdge[v+1] += Graph->firstEdge[v];
+
+    next = (int*)malloc((Graph->numGraphVertices + 1) * sizeof(int));
+    memcpy(next, Graph->firstEdge, (Graph->numGraphVertices + 1) * sizeof(int));
+    sorted = (graphEdge*)malloc((Graph->numEdges > 0 ? Graph->numEdges : 1) * sizeof(graphEdge));
+    for(i = 0; i < Graph->numEdges; i++)
+        sorted[next[Graph->edges[i].src]++] = Graph->edges[i];
+    free(Graph->edges);
+    free(next);
+    Graph->edges = sorted;
 }
 
 void printGraph(graph *Graph)
 {
-    int i;
+    int i, k;
+    graphEdge *cur;
     for (i = 0; i < Graph->numGraphVertices; ++i)
     {
-        adjList *cur = Graph->vertexListArray[i].root;
-        printf("\nAdjacency list of vertex %d %s \nroot ", i, Graph->vertexListArray[i].key);
-        while (cur)
+        printf("\nAdjacency list of vertex %d %s \nroot ", i, 
+               mpiOpNames[Graph->vertexListArray[i].op]);
+        for (k = Graph->firstEdge[i]; k < Graph->firstEdge[i+1]; k++)
         {
-            printf("-> %d %s %ld", cur->dest, Graph->vertexListArray[cur->dest].key, 
+            cur = &Graph->edges[k];
+            printf("-> %d %s %ld", cur->dest, mpiOpNames[Graph->vertexListArray[cur->dest].op], 
                    cur->weight);
-            cur = cur->next;
         }
         printf("\n");
     }
 }
-opCount **allocateOpSeqCount()
+
+uint64_t requestHandle(MPI_Request request)
 {
-    int i;
-    opCount *vals, **temp;
+    uint64_t handle = 0;
 
-    // allocate values
-    vals = (opCount *) malloc (numNodes * _NUM_MPI_OPS_ * sizeof(opCount));
+    memcpy(&handle, &request, sizeof(request) < sizeof(handle) ? sizeof(request) : sizeof(handle));
+    return handle;
+}
 
-    // allocate vector of pointers
-    temp = (opCount **) malloc (_NUM_MPI_OPS_ * sizeof(opCount*));
+int requestSlotOf(uint64_t handle)
+{
+    handle ^= handle >> 33;
+    handle *= 0xff51afd7ed558ccdull;
+    handle ^= handle >> 33;
+    return (int)(handle & (requestTableSize - 1));
+}
 
-    for(i=0; i < _NUM_MPI_OPS_; i++)
-        temp[i] = &(vals[i * numNodes]);
+void growRequestTable()
+{
+    int i, slot, oldSize = requestTableSize;
+    requestSlot *old = requestTable;
+
+    requestTableSize = oldSize ? 2 * oldSize : 1024;
+    requestTable = (requestSlot*)malloc(requestTableSize * sizeof(requestSlot));
+    for(i = 0; i < requestTableSize; i++)
+        requestTable[i].event = -1;
+    for(i = 0; i < oldSize; i++)
+        if(old[i].event >= 0)
+        {
+            for(slot = requestSlotOf(old[i].handle); requestTable[slot].event >= 0; 
+                slot = (slot + 1) & (requestTableSize - 1));
+            requestTable[slot] = old[i];
+        }
+    free(old);
+}
 
-    return temp;
+void insertRequest(int event, MPI_Request request)
+{
+    int slot;
+    uint64_t handle = requestHandle(request);
+
+    if(request == MPI_REQUEST_NULL)
+        return;
+    if(2 * (numRequests + 1) > requestTableSize)
+        growRequestTable();
+    for(slot = requestSlotOf(handle); requestTable[slot].event >= 0; 
+        slot = (slot + 1) & (requestTableSize - 1))
+        if(requestTable[slot].handle == handle)
+        {
+            requestTable[slot].event = event;
+            return;
+        }
+    requestTable[slot].handle = handle;
+    requestTable[slot].event = event;
+    numRequests++;
 }
 
-void initOpSeqCount()
+/* Remove the request with this handle, returning its event or -1. Later
+ * entries of the probe run move back into the gap, so lookups never
+ * need tombstones. */
+int takeRequest(uint64_t handle)
 {
-    int i, j;
-    for(i = 0; i < _NUM_MPI_OPS_; i++)
-        for(j = 0; j < numNodes; j++)
-            opSeqCount[i][j].head = NULL;
+    int slot, next, home, event;
+
+    if(requestTableSize == 0)
+        return -1;
+    for(slot = requestSlotOf(handle); requestTable[slot].event >= 0; 
+        slot = (slot + 1) & (requestTableSize - 1))
+        if(requestTable[slot].handle == handle)
+            break;
+    if((event = requestTable[slot].event) < 0)
+        return -1;
+
+    for(next = (slot + 1) & (requestTableSize - 1); requestTable[next].event >= 0; 
+        next = (next + 1) & (requestTableSize - 1))
+    {
+        home = requestSlotOf(requestTable[next].handle);
+        // move it unless its home lies cyclically in (slot, next]
+        if((slot < next) ? (home <= slot || home > next) : (home <= slot && home > next))
+        {
+            requestTable[slot] = requestTable[next];
+            slot = next;
+        }
+    }
+    requestTable[slot].event = -1;
+    numRequests--;
+    return event;
 }
 
+/* The handles of count requests, in local if they fit */
+uint64_t *requestHandles(int count, MPI_Request *requests, uint64_t *local)
+{
+    int i;
+    uint64_t *handles = (count <= REQUEST_HANDLES) ? local 
+                        : (uint64_t*)malloc(count * sizeof(uint64_t));
 
-char* getWaitingOnKey(MPI_Request *request)
+    for(i = 0; i < count; i++)
+        handles[i] = requestHandle(requests[i]);
+    return handles;
+}
+
+int seqSlotOf(int op, int peer, int tag, int comm)
 {
-    struct requestList *cur = requestHead;
-    while(cur)
-    {
-        if(cur->request == request && cur->visited != 1)
+    uint64_t h;
+
+    h = ((uint64_t)(uint32_t)op << 32 | (uint32_t)peer) * 0x9e3779b97f4a7c15ull;
+    h ^= ((uint64_t)(uint32_t)tag << 32 | (uint32_t)comm) * 0xc2b2ae3d27d4eb4full;
+    h ^= h >> 31;
+    return (int)(h & (seqTableSize - 1));
+}
+
+void growSeqTable()
+{
+    int i, slot, oldSize = seqTableSize;
+    seqSlot *old = seqTable;
+
+    seqTableSize = oldSize ? 2 * oldSize : 256;
+    seqTable = (seqSlot*)calloc(seqTableSize, sizeof(seqSlot));
+    for(i = 0; i < oldSize; i++)
+        if(old[i].seq > 0)
         {
-            cur->visited = 1;
-            return cur->waitingOn;
+            for(slot = seqSlotOf(old[i].op, old[i].peer, old[i].tag, old[i].comm); 
+                seqTable[slot].seq > 0; slot = (slot + 1) & (seqTableSize - 1));
+            seqTable[slot] = old[i];
         }
-        cur = cur->next;
+    free(old);
+}
+
+/* Count one more call with this key and return its sequence number */
+int nextSeq(int op, int peer, int tag, int comm)
+{
+    int slot;
+    seqSlot *s;
+
+    if(2 * (numSeqKeys + 1) > seqTableSize)
+        growSeqTable();
+    for(slot = seqSlotOf(op, peer, tag, comm); seqTable[slot].seq > 0; 
+        slot = (slot + 1) & (seqTableSize - 1))
+    {
+        s = &seqTable[slot];
+        if(s->op == op && s->peer == peer && s->tag == tag && s->comm == comm)
+            return ++s->seq;
     }
+    s = &seqTable[slot];
+    s->op = op;
+    s->peer = peer;
+    s->tag = tag;
+    s->comm = comm;
+    numSeqKeys++;
+    return s->seq = 1;
 }
 
-void insertRequest(char *waitingOn, MPI_Request *request)
+int freeCommInfo(MPI_Comm comm, int keyval, void *value, void *extra)
 {
-    struct requestList *new = (struct requestList*)malloc(sizeof(struct requestList));
-    new->waitingOn = waitingOn;
-    new->request = request;
-    new->next = requestHead;
-    requestHead = new;
+    commInfo *info = (commInfo*)value;
+
+    free(info->worldRank);
+    free(info);
+    return MPI_SUCCESS;
 }
 
-int setAndGetCount(opCount *op, int tag)
+/* Give a newly made intracommunicator its id, collectively over its members */
+void nameComm(MPI_Comm comm)
 {
-    int retval;
-    struct opCountNode *cur = op->head, *new;
-    while(cur != NULL && cur->tag != tag)
-        cur = cur->next;
+    int i, rank, size, isInter, *ranks;
+    MPI_Group group;
+    commInfo *info;
+
+    if(comm == MPI_COMM_NULL || commKeyval == MPI_KEYVAL_INVALID)
+        return;
+    PMPI_Comm_test_inter(comm, &isInter);
+    if(isInter)
+        return;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Comm_size(comm, &size);
+
+    info = (commInfo*)malloc(sizeof(commInfo));
+    info->id = SELF_COMM_ID + 1 + myRank + numNodes * numCommIds;
+    if(rank == 0)
+        numCommIds++;
+    PMPI_Bcast(&info->id, 1, MPI_INT, 0, comm);
+
+    ranks = (int*)malloc(size * sizeof(int));
+    info->worldRank = (int*)malloc(size * sizeof(int));
+    for(i = 0; i < size; i++)
+        ranks[i] = i;
+    PMPI_Comm_group(comm, &group);
+    PMPI_Group_translate_ranks(group, size, ranks, worldGroup, info->worldRank);
+    PMPI_Group_free(&group);
+    free(ranks);
+    PMPI_Comm_set_attr(comm, commKeyval, info);
+}
 
-    if(cur == NULL)
-    {   
-        new = (struct opCountNode*)malloc(sizeof(struct opCountNode));
-        new->tag = tag;
-        new->count = 1;
-        retval = new->count;
-        new->next = op->head;
-        op->head = new;
+/* The id of comm, turning *peer, unless peer is NULL or not a rank, into
+ * a world rank; -1, and a peer of -1, for a communicator without an id */
+int commKey(MPI_Comm comm, int *peer)
+{
+    int found;
+    commInfo *info;
+
+    if(comm == MPI_COMM_WORLD)
+        return WORLD_COMM_ID;
+    if(comm == MPI_COMM_SELF)
+    {
+        if(peer != NULL && *peer >= 0)
+            *peer = myRank;
+        return SELF_COMM_ID;
     }
-    else
+    PMPI_Comm_get_attr(comm, commKeyval, &info, &found);
+    if(!found)
     {
-        cur->count = cur->count+1;
-        retval = cur->count;
+        if(peer != NULL)
+            *peer = -1;
+        return -1;
     }
-
-    return retval;
+    if(peer != NULL && *peer >= 0)
+        *peer = info->worldRank[*peer];
+    return info->id;
 }
 
-int isCollective(char *key)
+int isCollective(int op)
 {
     int i, retval = 0;
     for(i = 0; i < _NUM_COLLECTIVES_; ++i)
     {
-        if(strcmp(key, collectives[i])==0)
+        if(op == collectives[i])
         {
             retval = 1;
             break;
@@ -320,913 +599,1153 @@ int isCollective(char *key)
     return retval;
 }
 
+/* Collectives on MPI_COMM_WORLD, Init and Finalize become one vertex of the
+ * graph shared by all ranks; every rank's trace holds its own copy of it */
+int isShared(int op, int comm)
+{
+    return (isCollective(op) && comm == WORLD_COMM_ID) || op == _MPI_INIT_ 
+           || op == _MPI_FINALIZE_;
+}
 
-void countCollectives()
+/* Calls that complete requests */
+int isCompletion(int op)
 {
-    int j;
-    for (j = 0; j < numVertices[0]; ++j)
-    {
-        if(isCollective(keys[0][j].opName))
-            numCollectives++;
-    }
+    return op == _MPI_WAIT_ || op == _MPI_WAITALL_ || (op >= _MPI_WAITANY_ && op <= _MPI_TESTSOME_);
+}
+
+int isSend(int op)
+{
+    return op == _MPI_SEND_ || op == _MPI_ISEND_;
+}
+
+int isReceive(int op)
+{
+    return op == _MPI_RECV_ || op == _MPI_IRECV_;
+}
+
+/* ================== Timebase ================== *
+ * Calls are timed in raw ticks of the TSC where there is one, else of
+ * CLOCK_MONOTONIC, so the wrappers pay for one instruction. The ticks are
+ * mapped to CLOCK_MONOTONIC nanoseconds by the pair of readings taken at
+ * MPI_Init and MPI_Finalize. Each rank also measures its offset from rank
+ * 0's clock by ping-pong at both points, keeping the exchange with the
+ * shortest round trip, and the change between the two gives the drift,
+ * so every trace ends up on rank 0's timebase. The ping-pong runs on a
+ * private copy of MPI_COMM_WORLD so no application receive can take it. */
+#define SYNC_ROUNDS 16
+#define SYNC_TAG    32767
+
+typedef struct clockMark
+{
+    uint64_t ticks, ns;
+    int64_t offset;         // rank 0's clock minus ours
+    uint64_t at;            // our clock when the offset was measured
+} clockMark;
+
+clockMark clockMarks[2];
+MPI_Comm syncComm;
+
+uint64_t monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t readTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonicNs();
+#endif
 }
 
-void decomposeKey(graphVertex *vertex)
+/* Pair the tick counter with CLOCK_MONOTONIC, then measure the offset to
+ * rank 0; every rank calls it, rank 0 answering the others in turn */
+void markClock(clockMark *mark)
 {
-    char *buf, i = 0;
-    char *string = (char*)malloc(strlen(vertex->key) + 1);
-    strcpy(string, vertex->key);
-    buf = strtok(string,"+");
-    while(buf)
+    int i, k;
+    uint64_t before, after, theirs, best = UINT64_MAX;
+    MPI_Status status;
+
+    before = monotonicNs();
+    mark->ticks = readTicks();
+    after = monotonicNs();
+    mark->ns = before + (after - before) / 2;
+    mark->offset = 0;
+    mark->at = mark->ns;
+
+    if(myRank == 0)
+    {
+        for(i = 1; i < numNodes; i++)
+            for(k = 0; k < SYNC_ROUNDS; k++)
+            {
+                PMPI_Recv(&theirs, 1, MPI_UINT64_T, i, SYNC_TAG, syncComm, &status);
+                theirs = monotonicNs();
+                PMPI_Send(&theirs, 1, MPI_UINT64_T, i, SYNC_TAG, syncComm);
+            }
+        return;
+    }
+    for(k = 0; k < SYNC_ROUNDS; k++)
     {
-        switch(i)
+        before = monotonicNs();
+        PMPI_Send(&before, 1, MPI_UINT64_T, 0, SYNC_TAG, syncComm);
+        PMPI_Recv(&theirs, 1, MPI_UINT64_T, 0, SYNC_TAG, syncComm, &status);
+        after = monotonicNs();
+        if(after - before < best)
         {
-            case 0 : vertex->opName = (char*)malloc(strlen(buf) + 1);
-                     strcpy(vertex->opName, buf);
-                     break;
-            case 1 : vertex->fromRank = atoi(buf);
-                     break;
-            case 2 : vertex->toRank = atoi(buf);
-                     break;
-            case 3 : vertex->tag = atoi(buf);
-                     break;
-            case 4 : vertex->opSeq = atoi(buf);
-                     break;
+            best = after - before;
+            mark->at = before + best / 2;
+            mark->offset = (int64_t)(theirs - mark->at);
         }
-        buf = strtok(NULL,"+");
-        i++;
     }
 }
 
-void generateKey(char *key, int op, int fromRank, int toRank, 
-                 int tag, int opSeq)
+/* Nanoseconds per tick between the two marks */
+double tickRate()
 {
-    char *baseOp, *buf;
-    switch(op)
-    {
-        case _MPI_INIT_         : baseOp = "MPI_Init"; break;
-        case _MPI_SEND_         : baseOp = "MPI_Send"; break;
-        case _MPI_RECV_         : baseOp = "MPI_Recv"; break;
-        case _MPI_ISEND_        : baseOp = "MPI_Isend"; break;
-        case _MPI_IRECV_        : baseOp = "MPI_Irecv"; break;
-        case _MPI_BARRIER_      : baseOp = "MPI_Barrier"; break;
-        case _MPI_SCATTER_      : baseOp = "MPI_Scatter"; break;
-        case _MPI_GATHER_       : baseOp = "MPI_Gather"; break;
-        case _MPI_REDUCE_       : baseOp = "MPI_Reduce"; break;
-        case _MPI_ALLREDUCE_    : baseOp = "MPI_Allreduce"; break;
-        case _MPI_WAIT_         : baseOp = "MPI_Wait"; break;
-        case _MPI_WAITALL_      : baseOp = "MPI_Waitall"; break;
-        case _MPI_ALLTOALL_     : baseOp = "MPI_Alltoall"; break;
-        case _MPI_FINALIZE_     : baseOp = "MPI_Finalize"; break;
-    }
+    uint64_t ticks = clockMarks[1].ticks - clockMarks[0].ticks;
 
-    strcpy(key, baseOp); strncat(key, PLUS, sizeof(PLUS));
-    buf = malloc(2);
-    sprintf(buf, "%d", fromRank); strncat(key, buf, sizeof(buf)); 
-    strncat(key, PLUS, sizeof(PLUS));    
-    sprintf(buf, "%d", toRank); strncat(key, buf, sizeof(buf)); 
-    strncat(key, PLUS, sizeof(PLUS));
-    sprintf(buf, "%d", tag); strncat(key, buf, sizeof(buf)); 
-    strncat(key, PLUS, sizeof(PLUS));
-    sprintf(buf, "%d", opSeq); strncat(key, buf, sizeof(buf));
+    return (ticks > 0) ? (double)(clockMarks[1].ns - clockMarks[0].ns) / ticks : 1.0;
 }
 
-void writeMetaData(int mpiOp, int fromRank, int toRank, int tag, 
-                   long int bytes, double latency, int opSeq)
+/* A tick reading as nanoseconds on rank 0's clock */
+uint64_t alignedNs(uint64_t ticks, double rate)
 {
-    vertexMetaData tmp;
-    char *buf, *bufStr, *_buf;
+    double ns, drift = 0.0;
+    clockMark *m0 = &clockMarks[0], *m1 = &clockMarks[1];
 
-    if(lastParentKey == NULL)
-        lastParentKey = "NULL";
+    ns = m0->ns + (double)(int64_t)(ticks - m0->ticks) * rate;
+    if(m1->at != m0->at)
+        drift = (double)(m1->offset - m0->offset) / (double)(int64_t)(m1->at - m0->at);
+    return (uint64_t)(ns + m0->offset + (ns - m0->at) * drift);
+}
 
-    switch(mpiOp)
+void flushEvents()
+{
+    if(eventFile == NULL)
     {
-        case _MPI_INIT_ : 
-                        fout = fopen(fileName, "w");
-                        
-                        if(myRank == 0)
-                        {
-                            tmp.key = malloc(30);
-                            generateKey(tmp.key, mpiOp, fromRank, toRank, 
-                                        tag, opSeq);
-                            fprintf(fout, "%s", tmp.key);
-                            fprintf(fout, "%s", FOUR_SPACES);
-                            buf = malloc(10);
-                            sprintf(buf, "%d", 0);
-                            fprintf(fout, "%s", buf);
-                            fprintf(fout, "%s","\n");
-                        }
-                        fclose(fout);
-
-                        break;
-        case _MPI_SEND_ : case _MPI_ISEND_ :
-                        fout = fopen(fileName, "a");
-                        
-
-                        tmp.key = malloc(50);
-                        tmp.interTreeChild = malloc(50);
-                        generateKey(tmp.key, mpiOp, fromRank, 
-                                    toRank, tag, opSeq);
-                        lastParentKey = tmp.key;
-                        fprintf(fout, "%s", tmp.key);
-                        fprintf(fout, "%s", FOUR_SPACES);
-                        buf = malloc(10);
-                        sprintf(buf, "%d", (int)round((endTime - startTime)));
-                        fprintf(fout, "%s", buf);
-                        fprintf(fout, "%s", FOUR_SPACES);
-                        generateKey(tmp.interTreeChild, _MPI_RECV_, fromRank, 
-                                    toRank, tag, opSeq);
-                        _buf = (char*)malloc(50);
-                        strcpy(_buf, tmp.interTreeChild);
-                        strcat(_buf, "||");
-                        generateKey(tmp.interTreeChild, _MPI_IRECV_, fromRank, 
-                                    toRank, tag, opSeq);
-                        strcat(_buf, tmp.interTreeChild);
-                        fprintf(fout, "%s", _buf);
-                        fprintf(fout, "%s", FOUR_SPACES);
-                        sprintf(buf, "%d", (int)round(latency));
-                        fprintf(fout, "%s", buf);
-                        fprintf(fout, "%s", FOUR_SPACES);
-                        sprintf(buf, "%ld", bytes);
-                        fprintf(fout, "%s", buf);
-                        fprintf(fout, "%s", "\n");
-
-                        fclose(fout);
-                        break;
-        case _MPI_IRECV_ : 
-        case _MPI_RECV_ : 
-                        fout = fopen(fileName, "a");
-
-                        tmp.key = malloc(50);
-                        generateKey(tmp.key, mpiOp, toRank, 
-                                    fromRank, tag, opSeq);
-                        fprintf(fout, "%s", tmp.key);
-                        fprintf(fout, "%s", FOUR_SPACES);
-                        
-                        buf = malloc(10);
-                        sprintf(buf, "%d", (int)round((endTime - startTime)));
-                        fprintf(fout, "%s", buf);
-                        fprintf(fout, "%s", "\n");
-
-                        fclose(fout);
- 
-                        break;
-                        
-        case _MPI_BARRIER_ : case _MPI_SCATTER_ : 
-        case _MPI_GATHER_  : case _MPI_ALLREDUCE_ :
-        case _MPI_ALLTOALL_ : case _MPI_REDUCE_:
-                        fout = fopen(fileName, "a");
-                        tmp.key = malloc(50);
-                        generateKey(tmp.key, mpiOp, fromRank, 
-                                    toRank, tag, opSeq);
-                        fprintf(fout, "%s", tmp.key);
-                        fprintf(fout, "%s", FOUR_SPACES);   
-                        buf = malloc(10);
-                        sprintf(buf, "%d", (int)round((endTime - startTime)));
-                        fprintf(fout, "%s", buf);
-                        fprintf(fout, "%s", FOUR_SPACES);
-                        fprintf(fout, "%s", "\n");
-                        
-                        fclose(fout);
-                        break;
-        
-        case _MPI_WAIT_         : 
-                        fout = fopen(fileName, "a");
-                        tmp.key = malloc(50);
-                        generateKey(tmp.key, mpiOp, fromRank, 
-                                    toRank, tag, opSeq);
-                        fprintf(fout, "%s", tmp.key);
-                        fprintf(fout, "%s", FOUR_SPACES);   
-                        buf = (char*)malloc(10);
-                        sprintf(buf, "%d", (int)round((endTime - startTime)));
-                        fprintf(fout, "%s", buf);
-                        fprintf(fout, "%s", FOUR_SPACES);
-                        _buf = getWaitingOnKey(curRequest);
-                        fprintf(fout, "%s", _buf);
-                        fprintf(fout, "%s", FOUR_SPACES);
-                        fprintf(fout, "%s", "\n");
-                        
-                        fclose(fout);
-                        break;
-        case _MPI_WAITALL_      : break;
-        
-        case _MPI_FINALIZE_ : 
-                        fout = fopen(fileName, "a");
-                        //if(myRank == 0)
-                        //{
-                            tmp.key = malloc(30);
-                            generateKey(tmp.key, mpiOp, fromRank, 
-                                        toRank, tag, opSeq);
-
-                            lastParentKey = tmp.key;
-                            fprintf(fout, "%s", tmp.key);
-                            fprintf(fout, "%s", FOUR_SPACES);
-                            buf = malloc(10);
-                            sprintf(buf, "%d", (int)round((endTime - startTime)));
-                            fprintf(fout, "%s", buf);
-                            fprintf(fout, "%s", "\n");
-                        //}
-                        buf = malloc(10); 
-                        sprintf(buf, "%d", totalOps);
-                        bufStr = malloc(strlen("totalOps=") + strlen(buf) + 1);
-                        bufStr = "totalOps=";
-                        fprintf(fout, "%s", bufStr);
-                        fprintf(fout, "%s", buf);
-                        fclose(fout);
-                        break;
+        eventFile = fopen(fileName, "wb");
+        if(eventFile == NULL)
+        {
+            perror(fileName);
+            PMPI_Abort(MPI_COMM_WORLD, 1);
+        }
     }
+    if(numBuffered > 0 && fwrite(events, sizeof(eventRecord), numBuffered, eventFile) 
+       != (size_t)numBuffered)
+        perror(fileName);
+    numFlushed += numBuffered;
+    numBuffered = 0;
+}
+
+/* Append one event, numbered among the calls sharing its key, and return
+ * its index in this rank's trace */
+int recordEvent(int mpiOp, int peer, int tag, int comm, long int bytes, 
+                uint64_t start, uint64_t end, int waitsOn)
+{
+    eventRecord *e;
+
+    if(numBuffered == EVENT_BUFFER_SIZE)
+        flushEvents();
+    e = &events[numBuffered++];
+    e->op = mpiOp;
+    e->peer = peer;
+    e->tag = tag;
+    e->comm = comm;
+    if(isSend(mpiOp))
+        e->seq = nextSeq(_MPI_SEND_, peer, tag, comm);
+    else if(isReceive(mpiOp))
+        e->seq = nextSeq(_MPI_RECV_, peer, tag, comm);
+    else e->seq = nextSeq(mpiOp, -1, -1, comm);
+    e->waitsOn = waitsOn;
+    e->bytes = bytes;
+    e->start = start;
+    e->end = end;
+    return numFlushed + numBuffered - 1;
+}
+
+MPI_Datatype byteType(int size)
+{
+    MPI_Datatype type;
+
+    PMPI_Type_contiguous(size, MPI_BYTE, &type);
+    PMPI_Type_commit(&type);
+    return type;
+}
 
+/* Record the completion, in a call of mpiOp, of the request whose handle
+ * was handle */
+void recordCompletion(int mpiOp, uint64_t handle, uint64_t start, uint64_t end)
+{
+    recordEvent(mpiOp, -1, -1, -1, 0, start, end, takeRequest(handle));
 }
 
-void push(adjList *edge)
+/* This rank's whole trace: the spilled blocks, read back and removed,
+ * followed by what is still buffered */
+eventRecord *localTrace(int *count)
 {
-    adjList *new = (adjList*)malloc(sizeof(adjList));
-    memcpy(new, edge, sizeof(adjList));
-    new->next = path;
-    path = new;
+    eventRecord *trace;
+
+    *count = numFlushed + numBuffered;
+    trace = (eventRecord*)malloc((*count > 0 ? *count : 1) * sizeof(eventRecord));
+    if(eventFile != NULL)
+    {
+        fclose(eventFile);
+        fin = fopen(fileName, "rb");
+        if(fin == NULL || fread(trace, sizeof(eventRecord), numFlushed, fin) 
+           != (size_t)numFlushed)
+            perror(fileName);
+        if(fin != NULL)
+            fclose(fin);
+        remove(fileName);
+        eventFile = NULL;
+    }
+    memcpy(trace + numFlushed, events, numBuffered * sizeof(eventRecord));
+    return trace;
 }
 
-void insertVertex(int vertex)
+/* Gather every rank's trace on rank 0, rank i's events starting at
+ * displs[i]; NULL on the other ranks */
+eventRecord *gatherTraces(eventRecord *trace, int count, int *counts, int *displs)
 {
-    struct llist *new = (struct llist*)malloc(sizeof(struct llist));
-    new->vertex = vertex;
-    new->next = root;
-    root = new;   
+    int i, total = 0;
+    eventRecord *all = NULL;
+    MPI_Datatype recordType = byteType(sizeof(eventRecord));
+
+    PMPI_Gather(&count, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if(myRank == 0)
+    {
+        for(i = 0; i < numNodes; i++)
+        {
+            displs[i] = total;
+            total += counts[i];
+        }
+        all = (eventRecord*)malloc((total > 0 ? total : 1) * sizeof(eventRecord));
+    }
+    PMPI_Gatherv(trace, count, recordType, all, counts, displs, recordType, 0, 
+                 MPI_COMM_WORLD);
+    PMPI_Type_free(&recordType);
+    return all;
 }
 
-void DFS_visit(graph *Graph, graphVertex *u)
+/* Fill one vertex per event of rank whichRank */
+void eventsToVertices(graphVertex *vertices, eventRecord *trace, int count, int whichRank)
 {
-    int i = 0;
+    int j;
+    eventRecord *e;
     graphVertex *v;
-    discoveryTime++;
-    u->d = discoveryTime;
-    u->color = GRAY;
 
-    adjList *cur = u->root;
-    while(cur)
+    for(j = 0; j < count; j++)
     {
-        v = &(Graph->vertexListArray[cur->dest]);
-        if(v->color == WHITE)
+        e = &trace[j];
+        v = &vertices[j];
+        v->op = e->op;
+        v->comm = e->comm;
+        v->fromRank = v->toRank = 0;
+        v->tag = -1;
+        v->opSeq = e->seq;
+        v->waitsOn = -1;
+        v->inTreeWeight = (j == 0) ? 0 : (long int)(e->start - trace[j-1].end);
+        v->start = e->start;
+        v->end = e->end;
+        v->bytes = 0;
+
+        if(isSend(e->op))
+        {
+            v->fromRank = whichRank;
+            v->toRank = e->peer;
+            v->tag = e->tag;
+            v->bytes = e->bytes;
+        }
+        else if(isReceive(e->op))
+        {
+            v->fromRank = e->peer;
+            v->toRank = whichRank;
+            v->tag = e->tag;
+        }
+        else if(isCompletion(e->op))
         {
-            v->parent = u->id;
-            DFS_visit(Graph,  v);
+            v->fromRank = whichRank;
+            if(e->waitsOn >= 0 && e->waitsOn < j)
+                v->waitsOn = e->waitsOn;
         }
-        cur = cur->next;
     }
+}
 
-    u->color = BLACK;
-    discoveryTime = discoveryTime + 1;
-    u->f = discoveryTime;
+/* A message takes from the start of its send until the receive, or the
+ * wait of an Irecv, returns */
+long int messageWeight(uint64_t sendStart, graphVertex *target)
+{
+    return (target->end > sendStart) ? (long int)(target->end - sendStart) : 0;
+}
 
-    insertVertex(u->id);
+/* Sends match receives of either kind, so both hash as one */
+uint64_t keyHash(int op, int comm, int fromRank, int toRank, int tag, int opSeq)
+{
+    uint64_t h;
+
+    if(isSend(op) || isReceive(op))
+        op = _MPI_SEND_;
+    h = ((uint64_t)(uint32_t)op << 32 | (uint32_t)fromRank) * 0x9e3779b97f4a7c15ull;
+    h ^= ((uint64_t)(uint32_t)toRank << 32 | (uint32_t)tag) * 0xc2b2ae3d27d4eb4full;
+    h ^= ((uint64_t)(uint32_t)comm << 32 | (uint32_t)opSeq) * 0xff51afd7ed558ccdull;
+    return h ^ (h >> 31);
 }
 
-void DFS(graph *Graph)
+void initIndex(matchIndex *index, int count)
 {
-    int i;
-    for(i = 0; i < Graph->numGraphVertices; ++i)
-    {
-        Graph->vertexListArray[i].color = WHITE;
-        Graph->vertexListArray[i].parent = -1;
-    }
-    discoveryTime = 0;
+    for(index->size = 16; index->size < 2 * count; index->size *= 2);
+    index->slots = (int*)calloc(index->size, sizeof(int));
+}
 
-    for(i = 0; i < Graph->numGraphVertices; ++i)
-    {
-        if(Graph->vertexListArray[i].color == WHITE)
-            DFS_visit(Graph, &(Graph->vertexListArray[i]));
-    }
+void insertIndex(matchIndex *index, graph *Graph, int vertex)
+{
+    graphVertex *v = &Graph->vertexListArray[vertex];
+    uint64_t slot = keyHash(v->op, v->comm, v->fromRank, v->toRank, v->tag, v->opSeq);
 
+    for(slot &= index->size - 1; index->slots[slot]; slot = (slot + 1) & (index->size - 1));
+    index->slots[slot] = vertex + 1;
 }
 
-void relax(graph* Graph, adjList *e)
+/* The indexed vertex matching key, -1 if none; isSend(op) finds the receive */
+int findIndex(matchIndex *index, graph *Graph, int op, int comm, int fromRank, int toRank, 
+              int tag, int opSeq)
 {
-    int v , w;
-    v = e->src; w = e->dest;
-    if(distTo[w] < distTo[v] + e->weight)
+    graphVertex *v;
+    uint64_t slot = keyHash(op, comm, fromRank, toRank, tag, opSeq);
+
+    for(slot &= index->size - 1; index->slots[slot]; slot = (slot + 1) & (index->size - 1))
     {
-        distTo[w] = distTo[v] + e->weight;
-        edgeTo[w] = e;
+        v = &Graph->vertexListArray[index->slots[slot] - 1];
+        if(v->comm == comm && v->fromRank == fromRank && v->toRank == toRank && 
+           v->tag == tag && v->opSeq == opSeq && (v->op == op || (isSend(op) && isReceive(v->op))))
+            return index->slots[slot] - 1;
     }
+    return -1;
 }
 
-void longestPathInGraph(graph *Graph)
+/* ================== Distributed critical path ================== *
+ * Each rank relaxes its own chain of events in order. A receive waits for
+ * the path length of its send, which the sending rank hands on in waves:
+ * every round the ranks advance as far as they can, then trade the lengths
+ * of the sends they reached with MPI_Alltoallv. A shared vertex waits for
+ * every rank to reach it and takes the longest incoming path by
+ * MPI_MAXLOC. The path is then traced back from MPI_Finalize, the cursor
+ * moving between ranks by MPI_Bcast, and only its edges are gathered. */
+
+typedef struct sendLength
 {
-    int i;
-    struct llist *cur = root;
-    adjList *e; 
-    
-    distTo = (long int*)malloc(Graph->numGraphVertices * sizeof(long int));
-    edgeTo = (struct adjList**)malloc(Graph->numGraphVertices * sizeof(struct adjList*));
+    int from, index;        // the sending rank and the send's place in its trace
+    int op, comm, tag, seq;
+    long int dist;          // the longest path to the send, then through its message
+    uint64_t start;
+    long int weight, bytes; // weight is only known at the receive
+} sendLength;
+
+typedef struct pathState
+{
+    long int dist;
+    int predRank, predIndex;    // where the longest path arrives from, -1 at the start
+    int isMessage;
+    int shared;                 // ordinal of a shared vertex, -1 otherwise
+    int expects, arrived;       // a message must arrive before dist is known
+    sendLength message;
+} pathState;
+
+/* One edge of the path, by rank and trace index; on rank 0 both ends
+ * map through vertexOf onto the graph */
+typedef struct pathEdge
+{
+    int step;                   // edges from MPI_Finalize back to this one
+    int srcRank, src, srcOp, srcComm;
+    int destRank, dest, destOp;
+    int isMessage;
+    long int weight, bytes;
+} pathEdge;
+
+typedef struct pathCursor
+{
+    int rank, index, shared, step;
+} pathCursor;
+
+graph chain;
+pathState *pathStates;
+int chainPos, numShared, *sharedAt, *waitAt;
+sendLength *pending;
+int numPending, pendingSize;
+matchIndex receives;
+MPI_Datatype lengthType;
+
+void queueLength(graphVertex *v, int index, long int dist)
+{
+    sendLength *l;
 
-    for(i = 0; i < Graph->numGraphVertices; ++i)
+    if(v->toRank < 0 || v->toRank >= numNodes)
+        return;
+    if(numPending == pendingSize)
     {
-        distTo[i] = (long int)-INFINITY;
-        edgeTo[i] = NULL;
+        pendingSize = pendingSize ? 2 * pendingSize : 64;
+        pending = (sendLength*)realloc(pending, pendingSize * sizeof(sendLength));
     }
+    l = &pending[numPending++];
+    l->from = myRank;
+    l->index = index;
+    l->op = v->op;
+    l->comm = v->comm;
+    l->tag = v->tag;
+    l->seq = v->opSeq;
+    l->start = v->start;
+    l->weight = 0;
+    l->bytes = v->bytes;
+    l->dist = dist;
+}
+
+/* Relax the chain as far as the known message lengths allow; with force
+ * the first blocked receive goes ahead without its message. Returns the
+ * number of vertices done. */
+int advanceChain(int force)
+{
+    int done = 0;
+    graphVertex *v;
+    pathState *p;
 
-    distTo[0] = 0;
-    // cur is for topological ordering of G
-    while(cur)
+    for(; chainPos < chain.numGraphVertices; chainPos++, done++)
     {
-        // e is for adjList of cur->vertex
-        e = Graph->vertexListArray[cur->vertex].root;
-        while(e)
+        v = &chain.vertexListArray[chainPos];
+        p = &pathStates[chainPos];
+        if(chainPos == 0)
         {
-            relax(Graph, e);
-            e = e->next;
+            p->dist = 0;
+            p->predRank = p->predIndex = -1;
+            continue;
         }
-        //Done with this vertex
-        cur = cur->next;
+        if(isShared(v->op, v->comm) || (p->expects && !p->arrived && !force))
+            break;
+        force = 0;
 
+        p->dist = pathStates[chainPos-1].dist + v->inTreeWeight;
+        p->predRank = myRank;
+        p->predIndex = chainPos - 1;
+        if(p->arrived && p->message.dist > p->dist)
+        {
+            p->dist = p->message.dist;
+            p->predRank = p->message.from;
+            p->predIndex = p->message.index;
+            p->isMessage = 1;
+        }
+        if(isSend(v->op))
+            queueLength(v, chainPos, p->dist);
     }
+    return done;
+}
 
-    for(e = edgeTo[rankOffsetInMatrix[1]-1]; e != NULL; e = edgeTo[e->src])
-        push(e);
+/* Send every queued length to the rank of its receive */
+void exchangeLengths()
+{
+    int i, j, total = 0;
+    int *sendCounts, *recvCounts, *sendDispls, *recvDispls;
+    sendLength *out, *in;
+    pathState *p;
+
+    sendCounts = (int*)calloc(4 * numNodes, sizeof(int));
+    recvCounts = sendCounts + numNodes;
+    sendDispls = recvCounts + numNodes;
+    recvDispls = sendDispls + numNodes;
+    for(i = 0; i < numPending; i++)
+        sendCounts[chain.vertexListArray[pending[i].index].toRank]++;
+    PMPI_Alltoall(sendCounts, 1, MPI_INT, recvCounts, 1, MPI_INT, MPI_COMM_WORLD);
+    for(i = 1; i < numNodes; i++)
+    {
+        sendDispls[i] = sendDispls[i-1] + sendCounts[i-1];
+        recvDispls[i] = recvDispls[i-1] + recvCounts[i-1];
+    }
+    total = recvDispls[numNodes-1] + recvCounts[numNodes-1];
 
-    e  = path;
-    while(e)
+    out = (sendLength*)malloc((numPending > 0 ? numPending : 1) * sizeof(sendLength));
+    in = (sendLength*)malloc((total > 0 ? total : 1) * sizeof(sendLength));
+    for(i = 0; i < numPending; i++)
+        out[sendDispls[chain.vertexListArray[pending[i].index].toRank]++] = pending[i];
+    for(i = 0; i < numNodes; i++)
+        sendDispls[i] -= sendCounts[i];
+    PMPI_Alltoallv(out, sendCounts, sendDispls, lengthType, in, recvCounts, recvDispls, 
+                   lengthType, MPI_COMM_WORLD);
+    numPending = 0;
+
+    // a message for an Irecv arrives at the wait that completes it
+    for(i = 0; i < total; i++)
     {
-        pathLength++; 
-        e = e->next;
+        j = findIndex(&receives, &chain, in[i].op, in[i].comm, in[i].from, myRank, 
+                      in[i].tag, in[i].seq);
+        if(j < 0)
+            continue;
+        if(waitAt[j] >= 0)
+            j = waitAt[j];
+        p = &pathStates[j];
+        if(j >= chainPos)
+        {
+            p->message = in[i];
+            p->message.weight = messageWeight(in[i].start, &chain.vertexListArray[j]);
+            p->message.dist += p->message.weight;
+            p->arrived = 1;
+        }
     }
-    criticalPath = (adjList*)malloc(pathLength * sizeof(adjList));
-    e = path; i = 0;
-    while(e)
+    free(out);
+    free(in);
+    free(sendCounts);
+}
+
+/* Every rank has reached the next shared vertex, or its end */
+void resolveShared()
+{
+    struct { long int dist; int rank; } mine, best;
+    pathState *p;
+
+    mine.rank = myRank;
+    if(chainPos < chain.numGraphVertices)
+        mine.dist = pathStates[chainPos-1].dist + chain.vertexListArray[chainPos].inTreeWeight;
+    else mine.dist = LONG_MIN;
+    PMPI_Allreduce(&mine, &best, 1, MPI_LONG_INT, MPI_MAXLOC, MPI_COMM_WORLD);
+    if(chainPos < chain.numGraphVertices)
     {
-        criticalPath[i].src = e->src;
-        criticalPath[i].dest = e->dest;
-        criticalPath[i].weight = e->weight;
-        criticalPath[i].bytes = e->bytes;
-        ++i;
-        e = e->next;
+        p = &pathStates[chainPos];
+        p->dist = best.dist;
+        p->predRank = best.rank;
+        p->predIndex = (best.rank == myRank) ? chainPos - 1 : -1;
+        p->shared = numShared;
+        sharedAt[numShared] = chainPos++;
     }
+    numShared++;
 }
 
+void addPathEdge(pathEdge **edges, int *count, int *size, int srcRank, int src, int srcOp, 
+                 int srcComm, int dest, long int weight, long int bytes, int isMessage, 
+                 int step)
+{
+    pathEdge *e;
 
-int idInGraph(graph *Graph, char* key, int whichRank)
+    if(*count == *size)
+    {
+        *size = *size ? 2 * *size : 64;
+        *edges = (pathEdge*)realloc(*edges, *size * sizeof(pathEdge));
+    }
+    e = &(*edges)[(*count)++];
+    e->step = step;
+    e->srcRank = srcRank;
+    e->src = src;
+    e->srcOp = srcOp;
+    e->srcComm = srcComm;
+    e->destRank = myRank;
+    e->dest = dest;
+    e->destOp = chain.vertexListArray[dest].op;
+    e->isMessage = isMessage;
+    e->weight = weight;
+    e->bytes = bytes;
+}
+
+/* Follow the path back from the cursor while it stays on this rank,
+ * leaving the cursor where it continues, rank -1 at MPI_Init */
+void traceBack(pathCursor *cursor, pathEdge **edges, int *count, int *size)
 {
-    int i, flag = -1;
-    for(i = rankOffsetInMatrix[whichRank]; i < rankOffsetInMatrix[whichRank+1]; ++i)
+    int j = (cursor->shared >= 0) ? sharedAt[cursor->shared] : cursor->index;
+    pathState *p;
+    graphVertex *v;
+
+    for(;;)
     {
-        if(strcmp(Graph->vertexListArray[i].key, key)==0)
+        p = &pathStates[j];
+        v = &chain.vertexListArray[j];
+        cursor->shared = -1;
+        if(p->predRank < 0)
         {
-            flag = i;
-            break;
+            cursor->rank = -1;
+            return;
+        }
+        if(p->isMessage)
+        {
+            addPathEdge(edges, count, size, p->predRank, p->predIndex, p->message.op, 
+                        p->message.comm, j, p->message.weight, p->message.bytes, 1, 
+                        cursor->step++);
+            cursor->rank = p->predRank;
+            cursor->index = p->predIndex;
+            return;
         }
+        if(p->predRank != myRank)
+        {
+            cursor->rank = p->predRank;
+            cursor->shared = p->shared;
+            return;
+        }
+        addPathEdge(edges, count, size, myRank, j - 1, chain.vertexListArray[j-1].op, 
+                    chain.vertexListArray[j-1].comm, j, v->inTreeWeight, 0, 0, cursor->step++);
+        j--;
     }
-    return flag ;
 }
 
-void isEdgeCritical(adjList *e)
+/* The critical path from MPI_Init to MPI_Finalize over every rank's
+ * trace; rank 0 gets its edges in order, the other ranks NULL */
+pathEdge *distributedCriticalPath(eventRecord *trace, int count, int *length)
 {
-    int i, flag = 1;
-    while(e && flag)
+    int i, j, force = 0, flags[3], any[3], numMine = 0, mineSize = 0, total = 0;
+    int *counts = NULL, *displs = NULL;
+    pathCursor cursor;
+    pathEdge *mine = NULL, *all = NULL, *ordered = NULL;
+    MPI_Datatype edgeType;
+
+    chain.numGraphVertices = count;
+    chain.vertexListArray = (graphVertex*)malloc((count > 0 ? count : 1) * sizeof(graphVertex));
+    eventsToVertices(chain.vertexListArray, trace, count, myRank);
+    pathStates = (pathState*)calloc(count > 0 ? count : 1, sizeof(pathState));
+    sharedAt = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    waitAt = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    initIndex(&receives, count);
+    for(j = 0; j < count; j++)
     {
-        for(i = 0; i < pathLength; ++i)
-            if(criticalPath[i].src == e->src &&
-               criticalPath[i].dest == e->dest &&
-               criticalPath[i].weight == e->weight)
-            {
-                if(flag)
-                    e->isCritical = 1;
-                flag = 0;
-            }
-        e = e->next;
+        pathStates[j].shared = -1;
+        waitAt[j] = -1;
+    }
+    for(j = 0; j < count; j++)
+        if(chain.vertexListArray[j].waitsOn >= 0)
+            waitAt[chain.vertexListArray[j].waitsOn] = j;
+    for(j = 0; j < count; j++)
+        if(isReceive(chain.vertexListArray[j].op))
+        {
+            insertIndex(&receives, &chain, j);
+            pathStates[waitAt[j] >= 0 ? waitAt[j] : j].expects = 1;
+        }
+
+    lengthType = byteType(sizeof(sendLength));
+    chainPos = numShared = numPending = 0;
+    for(;;)
+    {
+        flags[1] = advanceChain(force) > 0;
+        exchangeLengths();
+        flags[0] = chainPos < count && !isShared(chain.vertexListArray[chainPos].op, 
+                                                 chain.vertexListArray[chainPos].comm);
+        flags[2] = chainPos < count;
+        PMPI_Allreduce(flags, any, 3, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        if(!any[2])
+            break;
+        // receives whose sends were not traced, or that wait on each other,
+        // go ahead without their message once no rank can move
+        force = any[0] && !any[1];
+        if(!any[0])
+            resolveShared();
+    }
+    PMPI_Type_free(&lengthType);
+
+    cursor.rank = 0;
+    cursor.index = count - 1;
+    cursor.shared = -1;
+    cursor.step = 0;
+    PMPI_Bcast(&cursor, 4, MPI_INT, 0, MPI_COMM_WORLD);
+    while(cursor.rank >= 0)
+    {
+        i = cursor.rank;
+        if(myRank == i)
+            traceBack(&cursor, &mine, &numMine, &mineSize);
+        PMPI_Bcast(&cursor, 4, MPI_INT, i, MPI_COMM_WORLD);
+    }
+
+    edgeType = byteType(sizeof(pathEdge));
+    if(myRank == 0)
+    {
+        counts = (int*)malloc(numNodes * sizeof(int));
+        displs = (int*)malloc(numNodes * sizeof(int));
+    }
+    PMPI_Gather(&numMine, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if(myRank == 0)
+    {
+        for(i = 0; i < numNodes; i++)
+        {
+            displs[i] = total;
+            total += counts[i];
+        }
+        all = (pathEdge*)malloc((total > 0 ? total : 1) * sizeof(pathEdge));
     }
+    PMPI_Gatherv(mine, numMine, edgeType, all, counts, displs, edgeType, 0, MPI_COMM_WORLD);
+    PMPI_Type_free(&edgeType);
+    if(myRank == 0)
+    {
+        ordered = (pathEdge*)malloc((total > 0 ? total : 1) * sizeof(pathEdge));
+        for(i = 0; i < total; i++)
+            ordered[total - 1 - all[i].step] = all[i];
+        *length = total;
+        free(all);
+        free(counts);
+        free(displs);
+    }
+
+    free(mine);
+    free(pending);
+    pending = NULL;
+    pendingSize = 0;
+    free(receives.slots);
+    free(waitAt);
+    free(sharedAt);
+    free(pathStates);
+    free(chain.vertexListArray);
+    return ordered;
 }
 
 void fillDotGraph(graph *Graph)
 {
-    int i, j, boolExp;
-    char *buf, *colorAttr = "color=\"RED\"";
-    fout = fopen("dotGraph.txt", "w");
+    int i, j, k;
+    char *colorAttr = " color=\"RED\"";
+    graphEdge *cur;
+    graphVertex *v;
 
-    buf = (char*)malloc(200);
-    sprintf(buf, "digraph g{");
-    fprintf(fout, "%s\n", buf);
-    sprintf(buf, "overlap=scalexy");
-    fprintf(fout, "%s\n", buf);
-    sprintf(buf, "nodesep=0.6");
-    fprintf(fout, "%s\n", buf);
-    sprintf(buf, "node[fontsize=11]");
-    fprintf(fout, "%s\n", buf);
+    fout = fopen("dotGraph.txt", "w");
+    fprintf(fout, "digraph g{\n");
+    fprintf(fout, "overlap=scalexy\n");
+    fprintf(fout, "nodesep=0.6\n");
+    fprintf(fout, "node[fontsize=11]\n");
 
     for(i = 0; i < numNodes; i++)
     {
-        sprintf(buf, "subgraph cluster_%d{", i);
-        fprintf(fout, "%s\n", buf);
-        sprintf(buf, "label=\"Rank %d\"", i);
-        fprintf(fout, "%s\n", buf);
+        fprintf(fout, "subgraph cluster_%d{\n", i);
+        fprintf(fout, "label=\"Rank %d\"\n", i);
 
         //Create rank-wise non-collective vertices
         for(j = rankOffsetInMatrix[i]; j < rankOffsetInMatrix[i+1]; ++j)
         {
-            boolExp = (isCollective(Graph->vertexListArray[j].opName))
-                || (strcmp(Graph->vertexListArray[j].opName, "MPI_Init")== 0)
-                || (strcmp(Graph->vertexListArray[j].opName, "MPI_Finalize")== 0);
-            if(!boolExp)
-            {
-                sprintf(buf, "%d [label=\"%s\"];",j, Graph->vertexListArray[j].opName);
-                fprintf(fout, "%s\n", buf);
-            }
+            v = &Graph->vertexListArray[j];
+            if(!isShared(v->op, v->comm))
+                fprintf(fout, "%d [label=\"%s\"];\n", j, mpiOpNames[v->op]);
         }
 
-        sprintf(buf,"}");
-        fprintf(fout, "%s\n", buf);
+        fprintf(fout, "}\n");
     }
 
     for(j = rankOffsetInMatrix[0]; j < rankOffsetInMatrix[1]; j++)
     {
-        boolExp = (isCollective(Graph->vertexListArray[j].opName))
-                || (strcmp(Graph->vertexListArray[j].opName, "MPI_Init")== 0)
-                || (strcmp(Graph->vertexListArray[j].opName, "MPI_Finalize")== 0);
-        if(boolExp)
-        {
-            sprintf(buf, "%d [label=%s];", j, Graph->vertexListArray[j].opName);
-            fprintf(fout, "%s\n", buf);
-        }
-       
+        v = &Graph->vertexListArray[j];
+        if(isShared(v->op, v->comm))
+            fprintf(fout, "%d [label=%s];\n", j, mpiOpNames[v->op]);
     }
     fprintf(fout, "\n");
-    //Add edges
+
+    //Add edges, messages labelled with their bytes
     for (i = 0; i < Graph->numGraphVertices; ++i)
     {
-        adjList *cur = Graph->vertexListArray[i].root;
-        while (cur)
+        for(k = Graph->firstEdge[i]; k < Graph->firstEdge[i+1]; k++)
         {
-            isEdgeCritical(cur);
-            if((strcmp(Graph->vertexListArray[cur->src].opName, "MPI_Send")== 0)
-                || (strcmp(Graph->vertexListArray[cur->src].opName, "MPI_Isend")== 0))
-            {   
-                if(cur->next == NULL)
-                {
-                    if(cur->isCritical)
-                        sprintf(buf, "%d->%d [label=\"%ld(%ld)\" %s]", cur->src, cur->dest, 
-                            cur->weight, cur->bytes, colorAttr);
-                    else
-                        sprintf(buf, "%d->%d [label=\"%ld(%ld)\"]", cur->src, cur->dest, 
-                            cur->weight, cur->bytes);
-                    fprintf(fout, "%s\n", buf);
-                }
-                else
-                {
-                    if(cur->isCritical)
-                        sprintf(buf, "%d->%d [label=\"%ld\" %s]", 
-                                cur->src, cur->dest, cur->weight, colorAttr);
-                    else
-                        sprintf(buf, "%d->%d [label=\"%ld\"]", 
-                                cur->src, cur->dest, cur->weight);
-                    fprintf(fout, "%s\n", buf);
-                }
-            }
+            cur = &Graph->edges[k];
+            if(cur->isMessage)
+                fprintf(fout, "%d->%d [label=\"%ld(%ld)\"%s]\n", cur->src, cur->dest, 
+                        cur->weight, cur->bytes, criticalEdge[cur->dest] == k ? colorAttr : "");
             else
-            {
-                if(cur->isCritical)
-                    sprintf(buf, "%d->%d [label=\"%ld\" %s]", 
-                            cur->src, cur->dest, cur->weight, colorAttr);
-                else
-                    sprintf(buf, "%d->%d [label=\"%ld\"]", 
-                            cur->src, cur->dest, cur->weight);
-                fprintf(fout, "%s\n", buf);
-            }
-            cur = cur->next;
+                fprintf(fout, "%d->%d [label=\"%ld\"%s]\n", cur->src, cur->dest, 
+                        cur->weight, criticalEdge[cur->dest] == k ? colorAttr : "");
         }
     }
     fprintf(fout, "}");
     fclose(fout);
 }
 
-void writeToCritPathOut(graph *Graph)
+void writeToCritPathOut(pathEdge *edges, int length)
 {
     int i;
-    char *buf;
     FILE *fout;
 
-    buf = (char*)malloc(100);
     fout = fopen("critPath.out", "w");
-    for(i = 0; i < pathLength; ++i)
+    for(i = 0; i < length; ++i)
     {
-        if(isCollective(Graph->vertexListArray[criticalPath[i].src].opName)
-            || (strcmp(Graph->vertexListArray[criticalPath[i].src].opName, "MPI_Init")== 0))
-        {
-            sprintf(buf, "%s -1", Graph->vertexListArray[criticalPath[i].src].opName);
-            fprintf(fout, "%s\n", buf);
-            sprintf(buf, "%ld", criticalPath[i].weight);
-            fprintf(fout, "%s\n", buf);
-        }
-        else if((strcmp(Graph->vertexListArray[criticalPath[i].src].opName, "MPI_Send")== 0)
-                ||(strcmp(Graph->vertexListArray[criticalPath[i].src].opName, "MPI_Isend")== 0))
-        {
-            sprintf(buf, "%s %d", Graph->vertexListArray[criticalPath[i].src].opName,
-                    Graph->vertexListArray[criticalPath[i].src].fromRank);
-            fprintf(fout, "%s\n", buf);
-            if((strcmp(Graph->vertexListArray[criticalPath[i].src].opName, "MPI_Recv")== 0)
-                ||(strcmp(Graph->vertexListArray[criticalPath[i].src].opName, "MPI_Irecv")== 0)
-                ||(strcmp(Graph->vertexListArray[criticalPath[i].src].opName, "MPI_Wait")== 0))
-                sprintf(buf, "%ld", criticalPath[i].bytes);
-            else sprintf(buf, "%ld", criticalPath[i].weight);
-            fprintf(fout, "%s\n", buf);   
-        }
-        else if((strcmp(Graph->vertexListArray[criticalPath[i].src].opName, "MPI_Recv")== 0)
-                ||(strcmp(Graph->vertexListArray[criticalPath[i].src].opName, "MPI_Irecv")== 0))
-        {
-            sprintf(buf, "%s %d", Graph->vertexListArray[criticalPath[i].src].opName,
-                    Graph->vertexListArray[criticalPath[i].src].toRank);
-            fprintf(fout, "%s\n", buf);
-            sprintf(buf, "%ld", criticalPath[i].weight);
-            fprintf(fout, "%s\n", buf);   
-        }
-        else
-        {
-            sprintf(buf, "%s %d", Graph->vertexListArray[criticalPath[i].src].opName,
-                    Graph->vertexListArray[criticalPath[i].src].fromRank);
-            fprintf(fout, "%s\n", buf);
-            sprintf(buf, "%ld", criticalPath[i].weight);
-            fprintf(fout, "%s\n", buf);       
-        }
-        if(strcmp(Graph->vertexListArray[criticalPath[i].dest].opName, "MPI_Finalize")== 0)
-        {
-            sprintf(buf, "%s -1", Graph->vertexListArray[criticalPath[i].dest].opName);
-            fprintf(fout, "%s", buf);
-        }
+        if(isShared(edges[i].srcOp, edges[i].srcComm))
+            fprintf(fout, "%s -1\n", mpiOpNames[edges[i].srcOp]);
+        else fprintf(fout, "%s %d\n", mpiOpNames[edges[i].srcOp], edges[i].srcRank);
+        fprintf(fout, "%ld\n", edges[i].weight);
+        if(edges[i].destOp == _MPI_FINALIZE_)
+            fprintf(fout, "%s -1", mpiOpNames[edges[i].destOp]);
     }
 
     fclose(fout);
 }
 
-int partition(int* A, int p, int r)
+/* The path enters each of its vertices once, so the edge it takes into
+ * a vertex, -1 off the path, is enough to mark it in the dot graph */
+void mapCriticalPath(graph *Graph, pathEdge *edges, int length)
 {
-    int i, x, j, tmp;
-    x = A[r];
-    i = p-1;
-    for(j = p; j < r; j++)
+    int i, k, src, dest;
+    graphEdge *e;
+
+    criticalEdge = (int*)malloc((Graph->numGraphVertices > 0 ? Graph->numGraphVertices : 1) 
+                                * sizeof(int));
+    for(i = 0; i < Graph->numGraphVertices; i++)
+        criticalEdge[i] = -1;
+    for(i = 0; i < length; i++)
     {
-        if(A[j] <= x)
+        src = vertexOf[edges[i].srcRank][edges[i].src];
+        dest = vertexOf[edges[i].destRank][edges[i].dest];
+        for(k = Graph->firstEdge[src]; k < Graph->firstEdge[src+1]; k++)
         {
-            i = i + 1;
-            tmp = A[i];
-            A[i] = A[j];
-            A[j] = tmp;
+            e = &Graph->edges[k];
+            if(e->dest == dest && e->weight == edges[i].weight && 
+               e->isMessage == edges[i].isMessage)
+            {
+                criticalEdge[dest] = k;
+                break;
+            }
         }
     }
-    tmp = A[i+1];
-    A[i+1] = A[r];
-    A[r] = tmp;
+}
 
-    return i+1;
+/* Rescale s from ticks to ns, moving each bucket's calls to the bucket
+ * of its middle value */
+void statsToNs(opStats *s, double rate)
+{
+    int b;
+    uint64_t buckets[HIST_BUCKETS];
+
+    memcpy(buckets, s->buckets, sizeof(buckets));
+    memset(s->buckets, 0, sizeof(buckets));
+    for(b = 0; b < HIST_BUCKETS; b++)
+        if(buckets[b] > 0)
+            s->buckets[histBucket((uint64_t)(histValue(b) * rate + 0.5))] += buckets[b];
+    s->sum = (uint64_t)(s->sum * rate + 0.5);
+    s->min = (uint64_t)(s->min * rate + 0.5);
+    s->max = (uint64_t)(s->max * rate + 0.5);
 }
 
-void quicksort(int* A, int p, int r)
+/* MPI_Reduce operator over arrays of opStats */
+void mergeStats(void *invec, void *inoutvec, int *len, MPI_Datatype *datatype)
 {
-    int i,q;
-    if(p < r)
+    int i, b;
+    opStats *in = (opStats*)invec, *s = (opStats*)inoutvec;
+
+    for(i = 0; i < *len; i++, in++, s++)
     {
-        q = partition(A, p, r);
-        quicksort(A, p, q-1);
-        quicksort(A, q+1, r);
+        if(in->count == 0)
+            continue;
+        if(s->count == 0 || in->min < s->min)
+            s->min = in->min;
+        if(in->max > s->max)
+            s->max = in->max;
+        s->count += in->count;
+        s->sum += in->sum;
+        for(b = 0; b < HIST_BUCKETS; b++)
+            s->buckets[b] += in->buckets[b];
     }
 }
-void writeToStatsDat()
-{
-    int i,j,k, count, sum;
-    char *timeFile, *buf, *tmpFileName, *line = NULL, *bufLine = NULL;
-    char *bufToken = NULL;
-    ssize_t read; 
-    size_t len = 0;
-    int *timeVals[_NUM_MPI_OPS_], index[_NUM_MPI_OPS_];
-
-    times *curt;
-    buf = (char*)malloc(20);
-    timeFile = (char*)malloc(strlen("time") + 5);
-    strcpy(timeFile, "time");
-    sprintf(buf, "%d", myRank); strncat(timeFile, buf, sizeof(buf));
-    strncat(timeFile, ".txt", sizeof(".txt"));
 
-    fout = fopen(timeFile, "w");
+uint64_t quantile(opStats *s, double q)
+{
+    int b;
+    uint64_t want = (uint64_t)ceil(q * s->count), seen = 0, v;
 
-    for(k = 0; k < _NUM_MPI_OPS_; ++k)
+    if(want < 1)
+        want = 1;
+    for(b = 0; b < HIST_BUCKETS; b++)
     {
-        curt = mpiOpTimes[k];
-        sprintf(buf, "%s ", mpiOpNames[k]);
-        fprintf(fout, "%s", buf);
-        while(curt)
+        seen += s->buckets[b];
+        if(seen >= want)
         {
-            if(curt->next != NULL)
-            {
-                sprintf(buf, "%d ", curt->t);
-                fprintf(fout, "%s", buf);
-            }
-            else
-            {
-                sprintf(buf, "%d", curt->t);
-                fprintf(fout, "%s", buf);   
-            }
-            curt = curt->next;
-        }
-        
-        if(k != _NUM_MPI_OPS_ - 1)
-        {
-            sprintf(buf, "%s", "\n");
-            fprintf(fout, "%s", buf);
+            v = histValue(b);
+            return (v < s->min) ? s->min : (v > s->max) ? s->max : v;
         }
     }
+    return s->max;
+}
 
-    fclose(fout);
-    PMPI_Barrier(MPI_COMM_WORLD);
+void writeStatsLine(FILE *fp, opStats *s)
+{
+    fprintf(fp, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 
+            "\t%" PRIu64 "\n", s->count, s->count ? s->sum / s->count : 0, s->min, 
+            quantile(s, 0.5), quantile(s, 0.9), quantile(s, 0.99), s->max);
+}
+
+/* Merge every rank's call statistics on rank 0 and write the count,
+ * mean, min, p50, p90, p99 and max of each call, in ns, to stats.dat,
+ * followed by the same per message size for the point-to-point calls */
+void writeToStatsDat()
+{
+    int i, c, numStats = _NUM_MPI_OPS_ * (NUM_SIZE_CLASSES + 1);
+    double rate = tickRate();
+    opStats *all = NULL, *s;
+    MPI_Datatype statsType = byteType(sizeof(opStats));
+    MPI_Op mergeOp;
+
+    for(i = 0; i < _NUM_MPI_OPS_; i++)
+        for(c = 0; c <= NUM_SIZE_CLASSES; c++)
+            if(callStats[i][c].count > 0)
+                statsToNs(&callStats[i][c], rate);
     if(myRank == 0)
+        all = (opStats*)malloc(numStats * sizeof(opStats));
+    PMPI_Op_create(mergeStats, 1, &mergeOp);
+    PMPI_Reduce(callStats, all, numStats, statsType, mergeOp, 0, MPI_COMM_WORLD);
+    PMPI_Op_free(&mergeOp);
+    PMPI_Type_free(&statsType);
+    if(myRank != 0)
+        return;
+
+    fout = fopen("stats.dat", "w");
+    fprintf(fout, "Function\tInvocations\tMean\tMin\tp50\tp90\tp99\tMax\n");
+    for(i = 0; i < _NUM_MPI_OPS_-1; i++)
     {
-        fout = fopen("stats.dat", "w");
-        for(i = 0; i < numNodes; i++)
+        fprintf(fout, "%s\t", mpiOpNames[i]);
+        writeStatsLine(fout, &all[i * (NUM_SIZE_CLASSES + 1)]);
+    }
+
+    fprintf(fout, "\nFunction\tBytes\tInvocations\tMean\tMin\tp50\tp90\tp99\tMax\n");
+    for(i = 0; i < _NUM_MPI_OPS_; i++)
+        for(c = 0; c < NUM_SIZE_CLASSES; c++)
         {
-            tmpFileName = malloc(strlen("time") + 5);
-            strcpy(tmpFileName, "time");
-            sprintf(buf, "%d", i); strncat(tmpFileName, buf, sizeof(buf));
-            strncat(tmpFileName, ".txt", sizeof(".txt"));      
-            fin = fopen(tmpFileName, "r");
-            for(k = 0; k < _NUM_MPI_OPS_; k++)
-            {
-                read = getline(&line, &len, fin);
-                bufLine = (char*)malloc(strlen(line)+1);
-                strcpy(bufLine, line);
-                bufToken = strtok(bufLine, " \n");
-                bufToken = strtok(NULL, " \n");
-                while(bufToken)
-                {
-                    stats[k][0]++;
-                    bufToken = strtok(NULL, " \n");
-                }
-
-                index[k] = 0;
-                if(stats[k][0] > 0)
-                    timeVals[k] = (int*)malloc(stats[k][0] * sizeof(int));
-            }
-            fclose(fin);
+            s = &all[i * (NUM_SIZE_CLASSES + 1) + 1 + c];
+            if(s->count == 0)
+                continue;
+            fprintf(fout, "%s\t%s\t", mpiOpNames[i], sizeClassNames[c]);
+            writeStatsLine(fout, s);
         }
+    fclose(fout);
+    free(all);
+}
 
-        for(i = 0; i < numNodes; ++i)
+/* Build the graph on rank 0 from every rank's gathered trace. Rank 0 contributes
+ * all its vertices, the other ranks their point-to-point calls and waits,
+ * mapping their MPI_Init, collectives and MPI_Finalize onto rank 0's. */
+void buildGraph(eventRecord *traces, int *counts, int *displs)
+{
+    int i, j, g, total = 0, target, *waitOf;
+    graphVertex *v;
+    matchIndex index;
+
+    vertexOf = (int**)malloc(numNodes * sizeof(int*));
+    for(i = 0; i < numNodes; i++)
+    {
+        keys[i] = (graphVertex*)malloc((counts[i] > 0 ? counts[i] : 1) * sizeof(graphVertex));
+        eventsToVertices(keys[i], traces + displs[i], counts[i], i);
+        numVertices[i] = counts[i];
+        total += counts[i];
+    }
+
+    // a chain edge into every event and at most one message out of it
+    Graph = createGraph(total, 2 * total);
+    initIndex(&index, total);
+    g = 0;
+    for(i = 0; i < numNodes; i++)
+    {
+        rankOffsetInMatrix[i] = g;
+        vertexOf[i] = (int*)malloc(numVertices[i] * sizeof(int));
+        for(j = 0; j < numVertices[i]; j++)
         {
-            tmpFileName = malloc(strlen("time") + 5);
-            strcpy(tmpFileName, "time");
-            sprintf(buf, "%d", i); strncat(tmpFileName, buf, sizeof(buf));
-            strncat(tmpFileName, ".txt", sizeof(".txt"));      
-            fin = fopen(tmpFileName, "r");
-            for(k = 0; k < _NUM_MPI_OPS_; k++)
-            {
-                read = getline(&line, &len, fin);
-                bufLine = (char*)malloc(strlen(line)+1);
-                strcpy(bufLine, line);
-                bufToken = strtok(bufLine, " \n");
-                bufToken = strtok(NULL, " \n");
-                while(bufToken)
-                {
-                    timeVals[k][index[k]] = atoi(bufToken);
-                    bufToken = strtok(NULL, " \n");
-                    ++index[k];
-                }
-            }
-            fclose(fin);
+            v = &keys[i][j];
+            if(i > 0 && isShared(v->op, v->comm))
+                vertexOf[i][j] = findIndex(&index, Graph, v->op, v->comm, 0, 0, -1, v->opSeq);
+            else vertexOf[i][j] = -1;
+            if(vertexOf[i][j] >= 0)
+                continue;
+
+            // A new vertex, indexed if something has to find it
+            Graph->vertexListArray[g] = *v;
+            Graph->vertexListArray[g].id = g;
+            if(v->waitsOn >= 0)
+                Graph->vertexListArray[g].waitsOn = vertexOf[i][v->waitsOn];
+            if(isReceive(v->op) || (i == 0 && isShared(v->op, v->comm)))
+                insertIndex(&index, Graph, g);
+            vertexOf[i][j] = g++;
         }
+    }
+    rankOffsetInMatrix[numNodes] = numGraphVertices = Graph->numGraphVertices = g;
 
-        for(i = 0; i < _NUM_MPI_OPS_; ++i)
-            quicksort(timeVals[i], 0, stats[i][0]-1);
-       
-        for(i = 0 ; i < _NUM_MPI_OPS_; ++i)
-            if(stats[i][0] > 0)
-            {
-                stats[i][2] = timeVals[i][0];
-                stats[i][3] = timeVals[i][stats[i][0]/2];
-                stats[i][4] = timeVals[i][stats[i][0]-1];
-                sum = 0;
-                for(j = 0; j < stats[i][0]; j++)
-                    sum += timeVals[i][j];
-                stats[i][1] = sum/stats[i][0];
-            }
-        
-        sprintf(buf, "Function\tInvocations\tMean\tMin\tMedian\tMax\n");
-        fprintf(fout, "%s", buf);
+    // A message for an Irecv arrives at the wait that completes it
+    waitOf = (int*)malloc(g * sizeof(int));
+    for(j = 0; j < g; j++)
+        waitOf[j] = -1;
+    for(j = 0; j < g; j++)
+        if(Graph->vertexListArray[j].waitsOn >= 0)
+            waitOf[Graph->vertexListArray[j].waitsOn] = j;
 
-        for(i = 0; i < _NUM_MPI_OPS_-1; i++)
+    for(i = 0; i < numNodes; i++)
+    {
+        for(j = 0; j < numVertices[i]; j++)
         {
-            sprintf(buf, "%s\t", mpiOpNames[i]);
-            fprintf(fout, "%s", buf);
-            for(j = 0; j < 5; ++j)
-            {
-                sprintf(buf, "%d\t", stats[i][j]);
-                fprintf(fout, "%s", buf);
-            }
-            sprintf(buf, "\n");
-            fprintf(fout, "%s", buf);
+            v = &keys[i][j];
+            if(j > 0)
+                addEdge(Graph, vertexOf[i][j-1], vertexOf[i][j], v->inTreeWeight, 0, 0);
+            if(!isSend(v->op))
+                continue;
+            target = findIndex(&index, Graph, v->op, v->comm, v->fromRank, v->toRank, 
+                               v->tag, v->opSeq);
+            if(target < 0)
+                continue;
+            if(Graph->vertexListArray[target].op == _MPI_IRECV_ && waitOf[target] >= 0)
+                target = waitOf[target];
+            addEdge(Graph, vertexOf[i][j], target, 
+                    messageWeight(v->start, &Graph->vertexListArray[target]), v->bytes, 1);
         }
-        fclose(fout);
+        free(keys[i]);
     }
+    compressGraph(Graph);
 
+    free(waitOf);
+    free(index.slots);
 }
 
 /* ================== C Wrappers for MPI_Barrier ================== */
 _EXTERN_C_ int PMPI_Barrier(MPI_Comm arg_0);
 _EXTERN_C_ int MPI_Barrier(MPI_Comm arg_0) 
 { 
-    int _wrap_py_return_val = 0, count;
+    int _wrap_py_return_val = 0;
     totalOps++;
     
-    
-    endTime = MPI_Wtime();
-    
-  {
-    stime = MPI_Wtime();
+    stime = readTicks();
     _wrap_py_return_val = PMPI_Barrier(arg_0);
-    etime = MPI_Wtime();
-    insert(&mpiOpTimes[_MPI_BARRIER_], (int)round((etime - stime)));
-  }
-  count = setAndGetCount(&opSeqCount[_MPI_BARRIER_][myRank], -1);
-    writeMetaData(_MPI_BARRIER_, 0, 0, -1, 0, 0, count); 
-    startTime = MPI_Wtime();
+    etime = readTicks();
+    addStat(_MPI_BARRIER_, -1, etime - stime);
+
+    recordEvent(_MPI_BARRIER_, -1, -1, commKey(arg_0, NULL), 0, stime, etime, -1);
     return _wrap_py_return_val;
 }
 
 /* ================== C Wrappers for MPI_Alltoall ================== */
-_EXTERN_C_ int PMPI_Alltoall(void *arg_0, int arg_1, MPI_Datatype arg_2, 
+_EXTERN_C_ int PMPI_Alltoall(MPI3_CONST void *arg_0, int arg_1, MPI_Datatype arg_2, 
                              void *arg_3, int arg_4, MPI_Datatype arg_5, 
                              MPI_Comm arg_6);
-_EXTERN_C_ int MPI_Alltoall(void *arg_0, int arg_1, MPI_Datatype arg_2, 
+_EXTERN_C_ int MPI_Alltoall(MPI3_CONST void *arg_0, int arg_1, MPI_Datatype arg_2, 
                             void *arg_3, int arg_4, MPI_Datatype arg_5, 
                             MPI_Comm arg_6) 
 { 
-    int _wrap_py_return_val = 0, count;
+    int _wrap_py_return_val = 0;
     totalOps++;
     
-    endTime = MPI_Wtime();
-    
-  {
-    stime = MPI_Wtime();
+    stime = readTicks();
     _wrap_py_return_val = PMPI_Alltoall(arg_0, arg_1, arg_2, arg_3, arg_4, 
                                         arg_5, arg_6);
-    etime = MPI_Wtime();
-    insert(&mpiOpTimes[_MPI_ALLTOALL_], (int)round((etime - stime)));
-  }
-  count = setAndGetCount(&opSeqCount[_MPI_ALLTOALL_][myRank], -1);
-    writeMetaData(_MPI_ALLTOALL_, 0, 0, -1, 0, 0, count); 
-    startTime = MPI_Wtime();
+    etime = readTicks();
+    addStat(_MPI_ALLTOALL_, -1, etime - stime);
+
+    recordEvent(_MPI_ALLTOALL_, -1, -1, commKey(arg_6, NULL), 0, stime, etime, -1);
     return _wrap_py_return_val;
 }
 
 /* ================== C Wrappers for MPI_Scatter ================== */
-_EXTERN_C_ int PMPI_Scatter(void *arg_0, int arg_1, MPI_Datatype arg_2, 
+_EXTERN_C_ int PMPI_Scatter(MPI3_CONST void *arg_0, int arg_1, MPI_Datatype arg_2, 
                             void *arg_3, int arg_4, MPI_Datatype arg_5, 
                             int arg_6, MPI_Comm arg_7);
-_EXTERN_C_ int MPI_Scatter(void *arg_0, int arg_1, MPI_Datatype arg_2, 
+_EXTERN_C_ int MPI_Scatter(MPI3_CONST void *arg_0, int arg_1, MPI_Datatype arg_2, 
                            void *arg_3, int arg_4, MPI_Datatype arg_5, 
                            int arg_6, MPI_Comm arg_7) 
 { 
-    int _wrap_py_return_val = 0, count;
+    int _wrap_py_return_val = 0;
     totalOps++;
-    endTime = MPI_Wtime();
-    {
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Scatter(arg_0, arg_1, arg_2, arg_3, arg_4, 
-                                         arg_5, arg_6, arg_7);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_SCATTER_], (int)round((etime - stime)));
-    }
-    count = setAndGetCount(&opSeqCount[_MPI_SCATTER_][myRank], -1);
-    writeMetaData(_MPI_SCATTER_, 0, 0, -1, 0, 0, count);
-    startTime = MPI_Wtime();
+
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Scatter(arg_0, arg_1, arg_2, arg_3, arg_4, 
+                                       arg_5, arg_6, arg_7);
+    etime = readTicks();
+    addStat(_MPI_SCATTER_, -1, etime - stime);
+
+    recordEvent(_MPI_SCATTER_, -1, -1, commKey(arg_7, NULL), 0, stime, etime, -1);
     return _wrap_py_return_val;
 }
 
 /* ================== C Wrappers for MPI_Gather ================== */
-_EXTERN_C_ int PMPI_Gather(void *arg_0, int arg_1, MPI_Datatype arg_2, 
+_EXTERN_C_ int PMPI_Gather(MPI3_CONST void *arg_0, int arg_1, MPI_Datatype arg_2, 
                            void *arg_3, int arg_4, MPI_Datatype arg_5, 
                            int arg_6, MPI_Comm arg_7);
-_EXTERN_C_ int MPI_Gather(void *arg_0, int arg_1, MPI_Datatype arg_2, 
+_EXTERN_C_ int MPI_Gather(MPI3_CONST void *arg_0, int arg_1, MPI_Datatype arg_2, 
                           void *arg_3, int arg_4, MPI_Datatype arg_5, 
                           int arg_6, MPI_Comm arg_7) 
 { 
-    int _wrap_py_return_val = 0, count;
+    int _wrap_py_return_val = 0;
     totalOps++;
-    
-    endTime = MPI_Wtime();
  
-    {
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Gather(arg_0, arg_1, arg_2, arg_3, arg_4, 
-                                        arg_5, arg_6, arg_7);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_GATHER_], (int)round((etime - stime)));
-    }
-    count = setAndGetCount(&opSeqCount[_MPI_GATHER_][myRank], -1);
-    writeMetaData(_MPI_GATHER_, 0, 0, -1, 0, 0, count);
-    startTime = MPI_Wtime();
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Gather(arg_0, arg_1, arg_2, arg_3, arg_4, 
+                                      arg_5, arg_6, arg_7);
+    etime = readTicks();
+    addStat(_MPI_GATHER_, -1, etime - stime);
+
+    recordEvent(_MPI_GATHER_, -1, -1, commKey(arg_7, NULL), 0, stime, etime, -1);
     return _wrap_py_return_val;
 }
 
 /* ================== C Wrappers for MPI_Reduce ================== */
-_EXTERN_C_ int PMPI_Reduce(void *arg_0, void *arg_1, int arg_2, 
+_EXTERN_C_ int PMPI_Reduce(MPI3_CONST void *arg_0, void *arg_1, int arg_2, 
                            MPI_Datatype arg_3, MPI_Op arg_4, 
                            int arg_5, MPI_Comm arg_6);
-_EXTERN_C_ int MPI_Reduce(void *arg_0, void *arg_1, int arg_2, 
+_EXTERN_C_ int MPI_Reduce(MPI3_CONST void *arg_0, void *arg_1, int arg_2, 
                           MPI_Datatype arg_3, MPI_Op arg_4, 
                           int arg_5, MPI_Comm arg_6) 
 { 
-    int _wrap_py_return_val = 0, count;
+    int _wrap_py_return_val = 0;
     totalOps++;
-     endTime = MPI_Wtime();
-    {
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Reduce(arg_0, arg_1, arg_2, arg_3, arg_4, 
-                                        arg_5, arg_6);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_REDUCE_], (int)round((etime - stime)));
-    }
 
-    count = setAndGetCount(&opSeqCount[_MPI_REDUCE_][myRank], -1);
-    writeMetaData(_MPI_REDUCE_, 0, 0, -1, 0, 0, count);
-    startTime = MPI_Wtime();
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Reduce(arg_0, arg_1, arg_2, arg_3, arg_4, 
+                                      arg_5, arg_6);
+    etime = readTicks();
+    addStat(_MPI_REDUCE_, -1, etime - stime);
+
+    recordEvent(_MPI_REDUCE_, -1, -1, commKey(arg_6, NULL), 0, stime, etime, -1);
     return _wrap_py_return_val;
 }
 
 /* ================== C Wrappers for MPI_Allreduce ================== */
-_EXTERN_C_ int PMPI_Allreduce(void *arg_0, void *arg_1, int arg_2, 
+_EXTERN_C_ int PMPI_Allreduce(MPI3_CONST void *arg_0, void *arg_1, int arg_2, 
                               MPI_Datatype arg_3, MPI_Op arg_4, 
                               MPI_Comm arg_5);
-_EXTERN_C_ int MPI_Allreduce(void *arg_0, void *arg_1, int arg_2, 
+_EXTERN_C_ int MPI_Allreduce(MPI3_CONST void *arg_0, void *arg_1, int arg_2, 
                              MPI_Datatype arg_3, MPI_Op arg_4, 
                              MPI_Comm arg_5) 
 { 
-    int _wrap_py_return_val = 0, count;
+    int _wrap_py_return_val = 0;
     totalOps++;
-    endTime = MPI_Wtime();
-    {
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Allreduce(arg_0, arg_1, arg_2, arg_3, 
-                                           arg_4, arg_5);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_ALLREDUCE_], (int)round((etime - stime)));
-    }
 
-    count = setAndGetCount(&opSeqCount[_MPI_ALLREDUCE_][myRank], -1);
-    writeMetaData(_MPI_ALLREDUCE_, 0, 0, -1, 0, 0, count);
-    startTime = MPI_Wtime();
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Allreduce(arg_0, arg_1, arg_2, arg_3, 
+                                         arg_4, arg_5);
+    etime = readTicks();
+    addStat(_MPI_ALLREDUCE_, -1, etime - stime);
+
+    recordEvent(_MPI_ALLREDUCE_, -1, -1, commKey(arg_5, NULL), 0, stime, etime, -1);
     return _wrap_py_return_val;
 }
 
 /* ================== C Wrappers for MPI_Send ================== */
-_EXTERN_C_ int PMPI_Send(void *buf, int cnt, MPI_Datatype datatype, int dest, 
+_EXTERN_C_ int PMPI_Send(MPI3_CONST void *buf, int cnt, MPI_Datatype datatype, int dest, 
                          int tag, MPI_Comm comm);
-_EXTERN_C_ int MPI_Send(void *buf, int cnt, MPI_Datatype datatype, int dest, 
+_EXTERN_C_ int MPI_Send(MPI3_CONST void *buf, int cnt, MPI_Datatype datatype, int dest, 
                          int tag, MPI_Comm comm) 
 { 
-    int _wrap_py_return_val = 0, count;
-    double latency;
-    int dtypeSize;
+    int _wrap_py_return_val = 0;
+    int dtypeSize, peer = dest, commId;
     MPI_Type_size(datatype, &dtypeSize);
-    latency = (0.000000291935 * cnt *sizeof(datatype)) + 0.000598493;
     totalOps++;
-    endTime = MPI_Wtime();
     
-    {
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Send(buf, cnt, datatype, dest, tag, comm);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_SEND_], (int)round((etime - stime)));
-    }
-
-    count = setAndGetCount(&opSeqCount[_MPI_SEND_][dest], tag);
-    writeMetaData(_MPI_SEND_, myRank, dest, tag, cnt * dtypeSize, latency, count);
-    startTime = MPI_Wtime();
-
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Send(buf, cnt, datatype, dest, tag, comm);
+    etime = readTicks();
+    addStat(_MPI_SEND_, (long int)cnt * dtypeSize, etime - stime);
+
+    commId = commKey(comm, &peer);
+    recordEvent(_MPI_SEND_, peer, tag, commId, (long int)cnt * dtypeSize, 
+                stime, etime, -1);
     return _wrap_py_return_val;
 }
 
 /* ================== C Wrappers for MPI_Isend ================== */
-_EXTERN_C_ int PMPI_Isend(void *buf, int cnt, MPI_Datatype datatype, int dest, 
+_EXTERN_C_ int PMPI_Isend(MPI3_CONST void *buf, int cnt, MPI_Datatype datatype, int dest, 
                          int tag, MPI_Comm comm, MPI_Request *request);
-_EXTERN_C_ int MPI_Isend(void *buf, int cnt, MPI_Datatype datatype, int dest, 
+_EXTERN_C_ int MPI_Isend(MPI3_CONST void *buf, int cnt, MPI_Datatype datatype, int dest, 
                          int tag, MPI_Comm comm, MPI_Request *request) 
 { 
-    int _wrap_py_return_val = 0, count;
-    double latency;
-    int dtypeSize;
-    char *tmp = NULL;
+    int _wrap_py_return_val = 0, event;
+    int dtypeSize, peer = dest, commId;
     MPI_Type_size(datatype, &dtypeSize);
-    latency = (0.000000291935 * cnt *sizeof(datatype)) + 0.000598493;
     totalOps++;
-    endTime = MPI_Wtime();
-    {
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Isend(buf, cnt, datatype, dest, tag, comm, request);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_ISEND_], (int)round((etime - stime)));
-    }
 
-    tmp = (char*)malloc(50);
-    count = setAndGetCount(&opSeqCount[_MPI_SEND_][dest], tag);
-    writeMetaData(_MPI_ISEND_, myRank, dest, tag, cnt * dtypeSize, latency, count);
-    generateKey(tmp, _MPI_ISEND_, myRank, dest, tag, count);
-    insertRequest(tmp, request);
-    startTime = MPI_Wtime();
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Isend(buf, cnt, datatype, dest, tag, comm, request);
+    etime = readTicks();
+    addStat(_MPI_ISEND_, (long int)cnt * dtypeSize, etime - stime);
+
+    commId = commKey(comm, &peer);
+    event = recordEvent(_MPI_ISEND_, peer, tag, commId, 
+                        (long int)cnt * dtypeSize, stime, etime, -1);
+    insertRequest(event, *request);
     return _wrap_py_return_val;
 }
 
@@ -1237,21 +1756,20 @@ _EXTERN_C_ int PMPI_Recv(void *buf, int cnt, MPI_Datatype datatype, int source,
 _EXTERN_C_ int MPI_Recv(void *buf, int cnt, MPI_Datatype datatype, int source, 
                          int tag, MPI_Comm comm, MPI_Status *status) 
 { 
-    int _wrap_py_return_val = 0, count;
+    int _wrap_py_return_val = 0;
+    int dtypeSize, peer = source, commId;
+    MPI_Type_size(datatype, &dtypeSize);
     totalOps++;
-    endTime = MPI_Wtime();
      
-    {
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Recv(buf, cnt, datatype, source, tag, 
-                                      comm, status);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_RECV_], (int)round((etime - stime)));
-    }
-
-    count = setAndGetCount(&opSeqCount[_MPI_RECV_][source], tag);
-    writeMetaData(_MPI_RECV_, myRank, source, tag, cnt, 0, count);
-    startTime = MPI_Wtime();
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Recv(buf, cnt, datatype, source, tag, 
+                                    comm, status);
+    etime = readTicks();
+    addStat(_MPI_RECV_, (long int)cnt * dtypeSize, etime - stime);
+
+    commId = commKey(comm, &peer);
+    recordEvent(_MPI_RECV_, peer, tag, commId, (long int)cnt * dtypeSize, 
+                stime, etime, -1);
     return _wrap_py_return_val;
 }
 
@@ -1263,70 +1781,295 @@ _EXTERN_C_  int MPI_Irecv(void *buf, int cnt, MPI_Datatype datatype, int source,
                              int tag, MPI_Comm comm, MPI_Request *request)
 
 { 
-    int _wrap_py_return_val = 0, count;
-    char *tmp;
+    int _wrap_py_return_val = 0, event;
+    int dtypeSize, peer = source, commId;
+    MPI_Type_size(datatype, &dtypeSize);
     totalOps++;
-    endTime = MPI_Wtime();
-    {
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Irecv(buf, cnt, datatype, source, tag, 
-                                      comm, request);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_IRECV_], (int)round((etime - stime)));
-    }
 
-    tmp = (char*)malloc(50);
-    count = setAndGetCount(&opSeqCount[_MPI_RECV_][source], tag);
-    writeMetaData(_MPI_IRECV_, myRank, source, tag, cnt, 0, count);
-    generateKey(tmp, _MPI_IRECV_, source, myRank, tag, count);
-    insertRequest(tmp, request);
-    startTime = MPI_Wtime();
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Irecv(buf, cnt, datatype, source, tag, 
+                                     comm, request);
+    etime = readTicks();
+    addStat(_MPI_IRECV_, (long int)cnt * dtypeSize, etime - stime);
+
+    commId = commKey(comm, &peer);
+    event = recordEvent(_MPI_IRECV_, peer, tag, commId, 
+                        (long int)cnt * dtypeSize, stime, etime, -1);
+    insertRequest(event, *request);
     return _wrap_py_return_val;
 }
 /* ================== C Wrappers for MPI_Wait ================== */
 _EXTERN_C_ int PMPI_Wait(MPI_Request *request, MPI_Status *arg_1);
 _EXTERN_C_ int MPI_Wait(MPI_Request *request, MPI_Status *arg_1) 
 { 
-    int _wrap_py_return_val = 0, count;
+    int _wrap_py_return_val = 0;
+    uint64_t handle = requestHandle(*request);
     totalOps++;
-    endTime = MPI_Wtime();
-    curRequest = request;
-    {
-      stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Wait(request, arg_1);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_WAIT_], (int)round((etime - stime)));
-    }
 
-    count = setAndGetCount(&opSeqCount[_MPI_WAIT_][myRank], -1);
-    writeMetaData(_MPI_WAIT_, myRank, 0, -1, 0, 0, count);
-    startTime = MPI_Wtime();
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Wait(request, arg_1);
+    etime = readTicks();
+    addStat(_MPI_WAIT_, -1, etime - stime);
+
+    recordCompletion(_MPI_WAIT_, handle, stime, etime);
     return _wrap_py_return_val;
 }
 
 /* ================== C Wrappers for MPI_Waitall ================== */
+/* The requests are completed by polling PMPI_Testsome, so each gets its
+ * own event, running from the previous completion to its own */
 _EXTERN_C_ int PMPI_Waitall(int reqCount, MPI_Request *request, MPI_Status *arg_2);
 _EXTERN_C_ int MPI_Waitall(int reqCount, MPI_Request *request, MPI_Status *arg_2) 
 { 
-    int _wrap_py_return_val = 0, i, count;
+    int _wrap_py_return_val = MPI_SUCCESS, i, outCount;
+    int localIndices[REQUEST_HANDLES], *indices = localIndices;
+    uint64_t local[REQUEST_HANDLES], *handles = requestHandles(reqCount, request, local);
+    uint64_t from, done;
+    MPI_Request none = MPI_REQUEST_NULL;
+    MPI_Status *statuses = MPI_STATUSES_IGNORE;
+    totalOps++;
 
-    for(i = 0; i < reqCount; ++i)
+    if(reqCount > REQUEST_HANDLES)
+        indices = (int*)malloc(reqCount * sizeof(int));
+    if(arg_2 != MPI_STATUSES_IGNORE)
     {
-        totalOps++;
-        
-        endTime = MPI_Wtime();
-        curRequest = &request[i];
-        stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Waitall(reqCount, request, arg_2);
-
-      etime = MPI_Wtime();
-      count = setAndGetCount(&opSeqCount[_MPI_WAIT_][myRank], -1);
-        writeMetaData(_MPI_WAIT_, myRank, 0, -1, 0, 0, count);
-        startTime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_WAIT_], (int)round((etime - stime)));
+        // requests that start out null get the empty status a wait on null gives
+        statuses = (MPI_Status*)malloc((reqCount > 0 ? reqCount : 1) * sizeof(MPI_Status));
+        for(i = 0; i < reqCount; i++)
+            if(request[i] == MPI_REQUEST_NULL)
+                PMPI_Wait(&none, &arg_2[i]);
     }
-    
-   
+
+    stime = from = readTicks();
+    for(;;)
+    {
+        _wrap_py_return_val = PMPI_Testsome(reqCount, request, &outCount, indices, statuses);
+        if(_wrap_py_return_val != MPI_SUCCESS || outCount == MPI_UNDEFINED)
+            break;
+        if(outCount == 0)
+            continue;
+        done = readTicks();
+        for(i = 0; i < outCount; i++)
+        {
+            if(statuses != MPI_STATUSES_IGNORE)
+                arg_2[indices[i]] = statuses[i];
+            recordCompletion(_MPI_WAITALL_, handles[indices[i]], from, done);
+            from = done;
+        }
+    }
+    etime = readTicks();
+    addStat(_MPI_WAITALL_, -1, etime - stime);
+
+    if(statuses != MPI_STATUSES_IGNORE)
+        free(statuses);
+    if(indices != localIndices)
+        free(indices);
+    if(handles != local)
+        free(handles);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Waitany ================== */
+_EXTERN_C_ int PMPI_Waitany(int reqCount, MPI_Request *request, int *index, 
+                            MPI_Status *status);
+_EXTERN_C_ int MPI_Waitany(int reqCount, MPI_Request *request, int *index, 
+                           MPI_Status *status) 
+{ 
+    int _wrap_py_return_val = 0;
+    uint64_t local[REQUEST_HANDLES], *handles = requestHandles(reqCount, request, local);
+    totalOps++;
+
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Waitany(reqCount, request, index, status);
+    etime = readTicks();
+    addStat(_MPI_WAITANY_, -1, etime - stime);
+
+    if(*index != MPI_UNDEFINED)
+        recordCompletion(_MPI_WAITANY_, handles[*index], stime, etime);
+    if(handles != local)
+        free(handles);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Waitsome ================== */
+_EXTERN_C_ int PMPI_Waitsome(int reqCount, MPI_Request *request, int *outCount, 
+                             int *indices, MPI_Status *statuses);
+_EXTERN_C_ int MPI_Waitsome(int reqCount, MPI_Request *request, int *outCount, 
+                            int *indices, MPI_Status *statuses) 
+{ 
+    int _wrap_py_return_val = 0, i;
+    uint64_t local[REQUEST_HANDLES], *handles = requestHandles(reqCount, request, local);
+    totalOps++;
+
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Waitsome(reqCount, request, outCount, indices, statuses);
+    etime = readTicks();
+    addStat(_MPI_WAITSOME_, -1, etime - stime);
+
+    for(i = 0; *outCount != MPI_UNDEFINED && i < *outCount; i++)
+        recordCompletion(_MPI_WAITSOME_, handles[indices[i]], stime, etime);
+    if(handles != local)
+        free(handles);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Test ================== */
+/* A test records an event only when it completes something, so polling
+ * loops do not fill the trace; a null request always tests complete */
+_EXTERN_C_ int PMPI_Test(MPI_Request *request, int *flag, MPI_Status *status);
+_EXTERN_C_ int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status) 
+{ 
+    int _wrap_py_return_val = 0, active = (*request != MPI_REQUEST_NULL);
+    uint64_t handle = requestHandle(*request);
+    totalOps++;
+
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Test(request, flag, status);
+    etime = readTicks();
+    addStat(_MPI_TEST_, -1, etime - stime);
+
+    if(*flag && active)
+        recordCompletion(_MPI_TEST_, handle, stime, etime);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Testall ================== */
+_EXTERN_C_ int PMPI_Testall(int reqCount, MPI_Request *request, int *flag, 
+                            MPI_Status *statuses);
+_EXTERN_C_ int MPI_Testall(int reqCount, MPI_Request *request, int *flag, 
+                           MPI_Status *statuses) 
+{ 
+    int _wrap_py_return_val = 0, i;
+    uint64_t local[REQUEST_HANDLES], *handles = requestHandles(reqCount, request, local);
+    uint64_t none = requestHandle(MPI_REQUEST_NULL);
+    totalOps++;
+
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Testall(reqCount, request, flag, statuses);
+    etime = readTicks();
+    addStat(_MPI_TESTALL_, -1, etime - stime);
+
+    for(i = 0; *flag && i < reqCount; i++)
+        if(handles[i] != none)
+            recordCompletion(_MPI_TESTALL_, handles[i], stime, etime);
+    if(handles != local)
+        free(handles);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Testany ================== */
+_EXTERN_C_ int PMPI_Testany(int reqCount, MPI_Request *request, int *index, int *flag, 
+                            MPI_Status *status);
+_EXTERN_C_ int MPI_Testany(int reqCount, MPI_Request *request, int *index, int *flag, 
+                           MPI_Status *status) 
+{ 
+    int _wrap_py_return_val = 0;
+    uint64_t local[REQUEST_HANDLES], *handles = requestHandles(reqCount, request, local);
+    totalOps++;
+
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Testany(reqCount, request, index, flag, status);
+    etime = readTicks();
+    addStat(_MPI_TESTANY_, -1, etime - stime);
+
+    if(*flag && *index != MPI_UNDEFINED)
+        recordCompletion(_MPI_TESTANY_, handles[*index], stime, etime);
+    if(handles != local)
+        free(handles);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Testsome ================== */
+_EXTERN_C_ int PMPI_Testsome(int reqCount, MPI_Request *request, int *outCount, 
+                             int *indices, MPI_Status *statuses);
+_EXTERN_C_ int MPI_Testsome(int reqCount, MPI_Request *request, int *outCount, 
+                            int *indices, MPI_Status *statuses) 
+{ 
+    int _wrap_py_return_val = 0, i;
+    uint64_t local[REQUEST_HANDLES], *handles = requestHandles(reqCount, request, local);
+    totalOps++;
+
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Testsome(reqCount, request, outCount, indices, statuses);
+    etime = readTicks();
+    addStat(_MPI_TESTSOME_, -1, etime - stime);
+
+    for(i = 0; *outCount != MPI_UNDEFINED && i < *outCount; i++)
+        recordCompletion(_MPI_TESTSOME_, handles[indices[i]], stime, etime);
+    if(handles != local)
+        free(handles);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Comm_dup ================== */
+/* The communicator constructors are not traced, they only name the new
+ * communicator so its traffic can be matched */
+_EXTERN_C_ int PMPI_Comm_dup(MPI_Comm comm, MPI_Comm *newcomm);
+_EXTERN_C_ int MPI_Comm_dup(MPI_Comm comm, MPI_Comm *newcomm) 
+{ 
+    int _wrap_py_return_val = PMPI_Comm_dup(comm, newcomm);
+
+    if(_wrap_py_return_val == MPI_SUCCESS)
+        nameComm(*newcomm);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Comm_create ================== */
+_EXTERN_C_ int PMPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm *newcomm);
+_EXTERN_C_ int MPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm *newcomm) 
+{ 
+    int _wrap_py_return_val = PMPI_Comm_create(comm, group, newcomm);
+
+    if(_wrap_py_return_val == MPI_SUCCESS)
+        nameComm(*newcomm);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Comm_split ================== */
+_EXTERN_C_ int PMPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm);
+_EXTERN_C_ int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm) 
+{ 
+    int _wrap_py_return_val = PMPI_Comm_split(comm, color, key, newcomm);
+
+    if(_wrap_py_return_val == MPI_SUCCESS)
+        nameComm(*newcomm);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Comm_split_type ================== */
+_EXTERN_C_ int PMPI_Comm_split_type(MPI_Comm comm, int type, int key, MPI_Info info, 
+                                    MPI_Comm *newcomm);
+_EXTERN_C_ int MPI_Comm_split_type(MPI_Comm comm, int type, int key, MPI_Info info, 
+                                   MPI_Comm *newcomm) 
+{ 
+    int _wrap_py_return_val = PMPI_Comm_split_type(comm, type, key, info, newcomm);
+
+    if(_wrap_py_return_val == MPI_SUCCESS)
+        nameComm(*newcomm);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Cart_create ================== */
+_EXTERN_C_ int PMPI_Cart_create(MPI_Comm comm, int ndims, MPI3_CONST int dims[], 
+                                MPI3_CONST int periods[], int reorder, MPI_Comm *newcomm);
+_EXTERN_C_ int MPI_Cart_create(MPI_Comm comm, int ndims, MPI3_CONST int dims[], 
+                               MPI3_CONST int periods[], int reorder, MPI_Comm *newcomm) 
+{ 
+    int _wrap_py_return_val = PMPI_Cart_create(comm, ndims, dims, periods, reorder, newcomm);
+
+    if(_wrap_py_return_val == MPI_SUCCESS)
+        nameComm(*newcomm);
+    return _wrap_py_return_val;
+}
+
+/* ================== C Wrappers for MPI_Cart_sub ================== */
+_EXTERN_C_ int PMPI_Cart_sub(MPI_Comm comm, MPI3_CONST int remain_dims[], MPI_Comm *newcomm);
+_EXTERN_C_ int MPI_Cart_sub(MPI_Comm comm, MPI3_CONST int remain_dims[], MPI_Comm *newcomm) 
+{ 
+    int _wrap_py_return_val = PMPI_Cart_sub(comm, remain_dims, newcomm);
+
+    if(_wrap_py_return_val == MPI_SUCCESS)
+        nameComm(*newcomm);
     return _wrap_py_return_val;
 }
 
@@ -1335,45 +2078,29 @@ _EXTERN_C_ int PMPI_Init(int *argc, char ***argv);
 _EXTERN_C_ int MPI_Init(int *argc, char ***argv) 
 { 
     int _wrap_py_return_val = 0;
-    char *buf;
-    int i, j, count;
 
-    fileName = malloc(strlen(baseFileName) + 4);
-    buf = (char*)malloc(3);
-
-    for(i = 0; i < _NUM_MPI_OPS_; ++i)
-    {
-        mpiOpTimes[i] = NULL;
-        for(j = 0; j < 5; j++)
-        {
-                stats[i][j] = 0;
-        }
-    }
-
-    strcpy(fileName, baseFileName);
-    
-      stime = MPI_Wtime();
-      _wrap_py_return_val = PMPI_Init(argc, argv);
-      etime = MPI_Wtime();
-      insert(&mpiOpTimes[_MPI_INIT_], (int)round((etime - stime)));
-    
+    stime = readTicks();
+    _wrap_py_return_val = PMPI_Init(argc, argv);
+    etime = readTicks();
+    addStat(_MPI_INIT_, -1, etime - stime);
 
     MPI_Comm_rank(MPI_COMM_WORLD, &myRank); 
     MPI_Comm_size(MPI_COMM_WORLD, &numNodes);
+    PMPI_Comm_dup(MPI_COMM_WORLD, &syncComm);
+    markClock(&clockMarks[0]);
+    PMPI_Comm_group(MPI_COMM_WORLD, &worldGroup);
+    PMPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, freeCommInfo, &commKeyval, NULL);
 
-    opSeqCount = allocateOpSeqCount();
-    initOpSeqCount();
+    fileName = malloc(strlen(baseFileName) + 16);
+    sprintf(fileName, "%s%d.bin", baseFileName, myRank);
+    events = (eventRecord*)malloc(EVENT_BUFFER_SIZE * sizeof(eventRecord));
 
-    sprintf(buf, "%d", myRank); strncat(fileName, buf, sizeof(buf));
-    strncat(fileName, ".txt", 4);
-    count = setAndGetCount(&opSeqCount[_MPI_INIT_][myRank], -1);
-    startTime = MPI_Wtime();
-    writeMetaData(_MPI_INIT_, 0, 0, -1, 0, 0, count);
+    recordEvent(_MPI_INIT_, -1, -1, WORLD_COMM_ID, 0, stime, etime, -1);
     if(myRank == 0)
     {
         totalOps++;
         numVertices = (int*) malloc(numNodes * sizeof(int));
-        rankOffsetInMatrix = (int*) malloc(numNodes + 1 * sizeof(int));
+        rankOffsetInMatrix = (int*) malloc((numNodes + 1) * sizeof(int));
         keys = (graphVertex**) malloc (numNodes * sizeof(graphVertex*));
     }
 
@@ -1385,310 +2112,62 @@ _EXTERN_C_ int PMPI_Finalize();
 _EXTERN_C_ int MPI_Finalize() 
 { 
     int _wrap_py_return_val = 0;
-    char *buf = malloc(20);
-    char *tmpFileName;
-    char ch, *bufKey, *line = NULL, *bufLine = NULL;
-    char *starget, *tokens;
-    ssize_t read; 
-    size_t len = 0;
-    int idInMatrix, u, count;
-    adjList *v;
-    int countTillEquals = 0, i, j, k, t, totalVerticesSoFar = 0;
-    int firstNode, lastNode, ci, cj, flag = 10;
-    FILE *fp; 
-    graphVertex *vals = NULL;
-    struct llist *cur;
-
-    //if(myRank == 0)
-        totalOps++;
-
-    count = setAndGetCount(&opSeqCount[_MPI_FINALIZE_][myRank], -1);
-    endTime = MPI_Wtime();
-    //PMPI_Reduce(&endTime, &globalEndTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    //endTime = globalEndTime;
-    writeMetaData(_MPI_FINALIZE_, 0, 0, -1, 0, 0, count);    
-    PMPI_Barrier(MPI_COMM_WORLD);
-    bufKey = (char*)malloc(50);
-    if(myRank == 0)
-    {
-        for(i = 0; i < numNodes; i++)
-        {
-            tmpFileName = malloc(strlen("tmp") + 5);
-            strcpy(tmpFileName, "tmp");
-            sprintf(buf, "%d", i); strncat(tmpFileName, buf, sizeof(buf));
-            strncat(tmpFileName, ".txt", sizeof(".txt"));      
-
-            fin = fopen(tmpFileName, "r");
-            fseek(fin, -1, SEEK_END);
-            countTillEquals = 0;
-            ch = fgetc(fin);
-            while(ch != '=')
-            {
-                fseek(fin, -2, SEEK_CUR);
-                ch = fgetc(fin);
-                countTillEquals++;
-            }
-
-            for(j = 0; j < countTillEquals; j++)
-                buf[j] = fgetc(fin);
-            buf[j] = '\0';
-            
-            numVertices[i] = atoi(buf);
-
-            totalVerticesSoFar += numVertices[i];
-            keys[i] = (graphVertex*)realloc(vals, numVertices[i] * sizeof(graphVertex));
-
-            fclose(fin);
-            fin = fopen(tmpFileName, "r");
-            
-            for(j = 0; j < numVertices[i]; j++)
-            {
-                keys[i][j].key = NULL;
-                read = getline(&line, &len, fin);
-                bufLine = (char*)malloc(strlen(line)+1);
-                strcpy(bufLine, line);
-                if(read != -1)
-                {
-                    bufKey = strtok(line," \n");
-                    keys[i][j].key = (char*)malloc(strlen(bufKey) + 1);
-                    strcpy(keys[i][j].key, bufKey);
-
-                    k = -1;
-                    while(bufKey)
-                    {
-                        bufKey = strtok (NULL," \n");
-                        if(bufKey)
-                            if(k == -1)
-                                keys[i][j].inTreeWeight = atoi(bufKey);
-                        if(bufKey)
-                        {
-                            switch(k)
-                            {
-                                case 0: keys[i][j].sendTarget = 
-                                    (char*)malloc(strlen(bufKey)+1);
-                                        strcpy(keys[i][j].sendTarget, bufKey);
-                                        keys[i][j].recvTarget = 
-                                    (char*)malloc(strlen(bufKey)+1);
-                                        strcpy(keys[i][j].recvTarget, bufKey);
-                                        break;
-                                case 1: keys[i][j].interTreeWeight = atoi(bufKey);
-                                        break;
-                                case 2: keys[i][j].bytes = atoi(bufKey);
-                                        break;
-                            }
-                        }
-                        k++;
-                    }
-                    decomposeKey(&keys[i][j]);
-                }
-            }
-            fclose(fin);
-            //remove(tmpFileName);
-        }
-
-        countCollectives();
+    int k, numEvents, totalEvents, length = 0, *traceCounts = NULL, *traceDispls = NULL;
+    double rate;
+    eventRecord *trace, *traces = NULL;
+    pathEdge *edges;
 
+    totalOps++;
 
-        numGraphVertices = numVertices[0];
-        rankOffsetInMatrix[0] = 0;
-        for (i = 1; i < numNodes; ++i)
-        {
-            numGraphVertices += numVertices[i] - numCollectives - 1; 
-            rankOffsetInMatrix[i] = numGraphVertices - 
-                                    (numVertices[i] - numCollectives) + 1;
-        }
-        rankOffsetInMatrix[numNodes] = numGraphVertices;
-        
-        Graph = createGraph(numGraphVertices);        
-        j = 0;
+    stime = readTicks();
+    recordEvent(_MPI_FINALIZE_, -1, -1, WORLD_COMM_ID, 0, stime, stime, -1);
+    markClock(&clockMarks[1]);
+    trace = localTrace(&numEvents);
+    free(events);
+    rate = tickRate();
+    for(k = 0; k < numEvents; k++)
+    {
+        trace[k].start = alignedNs(trace[k].start, rate);
+        trace[k].end = alignedNs(trace[k].end, rate);
+    }
+    edges = distributedCriticalPath(trace, numEvents, &length);
 
-        for(i = 0; i < numNodes; i++)
+    // only a small trace is worth gathering whole for the dot graph
+    PMPI_Allreduce(&numEvents, &totalEvents, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if(myRank == 0)
+    {
+        traceCounts = (int*)malloc(numNodes * sizeof(int));
+        traceDispls = (int*)malloc(numNodes * sizeof(int));
+    }
+    if(totalEvents <= DOT_GRAPH_LIMIT)
+        traces = gatherTraces(trace, numEvents, traceCounts, traceDispls);
+    free(trace);
+    if(myRank == 0)
+    {
+        writeToCritPathOut(edges, length);
+        if(traces != NULL)
         {
-            if(i == 0)
-                lastNode = numVertices[i];
-            else lastNode = numVertices[i] - 1;
-            for(k = 0; k < lastNode; k++)
-            {
-                if(keys[i][k].opName != NULL)
-                {
-                    if(i == 0)
-                    {
-                        Graph->vertexListArray[j].key = (char*)malloc(strlen(keys[i][k].key)+1);
-                        strcpy(Graph->vertexListArray[j].key, keys[i][k].key);
-                        if(strcmp(keys[i][k].opName, "MPI_Wait")==0)
-                        {
-                            Graph->vertexListArray[j].recvTarget = (char*)malloc(strlen(keys[i][k].recvTarget)+1);
-                            strcpy(Graph->vertexListArray[j].recvTarget, keys[i][k].recvTarget);
-                        }
-                        decomposeKey(&Graph->vertexListArray[j]);
-                        j++;
-                    }
-                    else
-                    {
-                        if(!isCollective(keys[i][k].opName))
-                        {
-                            Graph->vertexListArray[j].key = (char*)malloc(strlen(keys[i][k].key)+1);
-                            strcpy(Graph->vertexListArray[j].key, keys[i][k].key);
-                            if(strcmp(keys[i][k].opName, "MPI_Wait")==0)
-                            {
-                                Graph->vertexListArray[j].recvTarget = (char*)malloc(strlen(keys[i][k].recvTarget)+1);
-                                strcpy(Graph->vertexListArray[j].recvTarget, keys[i][k].recvTarget);
-                            }
-                            decomposeKey(&Graph->vertexListArray[j]);
-                            j++;
-                        }
-                    }
-                }
-            }
-            
+            buildGraph(traces, traceCounts, traceDispls);
+            //printGraph(Graph);
+            mapCriticalPath(Graph, edges, length);
+            fillDotGraph(Graph);    
+            k = system("mv dotGraph.txt dotGraph.dot");
+            for(k = 0; k < numNodes; k++)
+                free(vertexOf[k]);
+            free(vertexOf);
         }
-
-        for(i = 0; i< numNodes; ++i)
-        {
-            if(i == 0)
-            {
-                firstNode = 1;
-                lastNode = numVertices[i] - 1;
-            }
-            else
-            {
-                firstNode = 0;
-                lastNode = numVertices[i] - 2;
-            }
-
-            if(i)
-            {
-                if(firstNode>=0 && lastNode >=0 && 
-                    (keys[i][firstNode].opName != NULL || keys[i][lastNode].opName != NULL))
-                { 
-                    if(isCollective(keys[i][firstNode].opName))
-                        addEdge(Graph, 0, 1, keys[i][firstNode].inTreeWeight, 0);  
-                    else addEdge(Graph, 0, idInGraph(Graph, keys[i][firstNode].key, i), 
-                                 keys[i][firstNode].inTreeWeight, 0);
-                    
-                    if(isCollective(keys[i][lastNode].opName))
-                        addEdge(Graph, idInGraph(Graph, keys[i][lastNode].key, 0), 
-                                numVertices[0] - 1, 
-                                keys[i][numVertices[i]-1].inTreeWeight, 0);  
-                    else
-                    { 
-                        if((strcmp(keys[i][lastNode].opName,"MPI_Send")==0)
-                            ||(strcmp(keys[i][lastNode].opName,"MPI_Isend")==0))
-                        {
-                            starget = (char*)malloc(50);
-                            strcpy(starget, keys[i][lastNode].sendTarget);
-                            tokens = strtok(starget, "|");
-                            if(idInGraph(Graph, tokens,keys[i][lastNode].toRank) == -1)
-                                tokens = strtok(NULL, "|");
-
-                            else flag = 0;
-                           
-                            // Check for a wait to add to
-                            for(ci = rankOffsetInMatrix[keys[i][lastNode].toRank]; 
-                                ci < rankOffsetInMatrix[keys[i][lastNode].toRank + 1]; ++ci)
-                            {
-                                if(strcmp(Graph->vertexListArray[ci].opName, "MPI_Wait")==0)
-                                {
-                                    if(strcmp(Graph->vertexListArray[ci].recvTarget, tokens)==0)
-                                    {
-                                        flag = 0;
-                                        addEdge(Graph, idInGraph(Graph,keys[i][lastNode].key,i), 
-                                                    ci, keys[i][t].interTreeWeight, keys[i][lastNode].bytes);
-                                    }
-                                }
-                            }
-                            if(idInGraph(Graph, tokens,keys[i][t].toRank) == -1 && flag)
-                                tokens = strtok(NULL, "|");
-                            if(flag)
-                                addEdge(Graph, idInGraph(Graph,keys[i][lastNode].key,i), 
-                                        idInGraph(Graph, tokens, keys[i][lastNode].toRank), 
-                                        keys[i][lastNode].interTreeWeight, keys[i][lastNode].bytes);
-                        }
-                        addEdge(Graph, rankOffsetInMatrix[i+1] - 1, 
-                                numVertices[0] -1, keys[i][numVertices[i]-1].inTreeWeight, 0);
-                    }
-                }
-            }
-            for(t = 0; t < lastNode; t++)
-            {
-                if(keys[i][t].opName != NULL || keys[i][t+1].opName != NULL)
-                {
-                    // Current Single op Send/Isend - One Span to Recv also
-                        if(isCollective(keys[i][t].opName))
-                        { 
-                            if(isCollective(keys[i][t+1].opName))
-                            {
-                                addEdge(Graph, idInGraph(Graph,keys[i][t].key,0),
-                                    idInGraph(Graph,keys[i][t+1].key,0),
-                                    keys[i][t+1].inTreeWeight, 0);
-                            }
-                            else addEdge(Graph, idInGraph(Graph,keys[i][t].key,0),
-                                    idInGraph(Graph,keys[i][t+1].key,i),
-                                    keys[i][t+1].inTreeWeight, 0);
-                        }
-                        else 
-                        {
-                            if((strcmp(keys[i][t].opName, "MPI_Send") == 0) 
-                            || (strcmp(keys[i][t].opName, "MPI_Isend") == 0))
-                            {
-                                starget = (char*)malloc(50);
-                                strcpy(starget, keys[i][t].sendTarget);
-                                tokens = strtok(starget, "|");
-                                if(idInGraph(Graph, tokens,keys[i][t].toRank) == -1)
-                                    tokens = strtok(NULL, "|");
-
-                                // Check for a wait to add to
-                                for(ci = rankOffsetInMatrix[keys[i][t].toRank]; 
-                                    ci < rankOffsetInMatrix[keys[i][t].toRank + 1]; ++ci)
-                                {
-                                    if(strcmp(Graph->vertexListArray[ci].opName, "MPI_Wait")==0)
-                                    {
-                                        if(strcmp(Graph->vertexListArray[ci].recvTarget, tokens)==0)
-                                        {
-                                            flag = 0;
-                                            addEdge(Graph, idInGraph(Graph,keys[i][t].key,i), 
-                                                    ci, keys[i][t].interTreeWeight, keys[i][t].bytes);
-                                        }
-                                    }
-                                }
-                                if(idInGraph(Graph, tokens,keys[i][t].toRank) == -1 && flag)
-                                    tokens = strtok(NULL, "|");
-
-                                if(flag)
-                                    addEdge(Graph, idInGraph(Graph,keys[i][t].key,i), 
-                                        idInGraph(Graph, tokens, keys[i][t].toRank), 
-                                        keys[i][t].interTreeWeight, keys[i][t].bytes);
-                            }
-
-                            if(isCollective(keys[i][t+1].opName))
-                                addEdge(Graph, idInGraph(Graph,keys[i][t].key,i),
-                                        idInGraph(Graph,keys[i][t+1].key,0),
-                                        keys[i][t+1].inTreeWeight, 0);
-                            else addEdge(Graph, idInGraph(Graph,keys[i][t].key,i),
-                                        idInGraph(Graph,keys[i][t+1].key,i),
-                                        keys[i][t+1].inTreeWeight, 0);
-
-                        }
-                }
-            }
-        }  
-        //printGraph(Graph);
-
-        DFS(Graph);
-        cur = root;
-        longestPathInGraph(Graph);
-        writeToCritPathOut(Graph);
-
-        u = 0;
-        cur = root;
-        fillDotGraph(Graph);    
-        k = system("mv dotGraph.txt dotGraph.dot");
-
+        else fprintf(stderr, "%d events are too many for the dot graph\n", totalEvents);
+        free(traces);
+        free(edges);
+        free(traceCounts);
+        free(traceDispls);
     }   
     writeToStatsDat();
+    PMPI_Comm_free(&syncComm);
+    PMPI_Group_free(&worldGroup);
     _wrap_py_return_val = PMPI_Finalize();
 
-    if(myRank == 0)
+    if(myRank == 0 && totalEvents <= DOT_GRAPH_LIMIT)
         k = system("dot -Tpng -oCritPathGraph.png dotGraph.dot");  
 
     return _wrap_py_return_val;